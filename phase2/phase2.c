@@ -47,6 +47,8 @@ void enableInterrupts(int oldPSR);
 int send(int mbox_id, void *msg_ptr, int msg_size, int isCond);
 int recv(int mbox_id, void *msg_ptr, int msg_max_size, int isCond);
 static void nullSys(USLOSS_Sysargs *args);
+static void syscallStatsSys(USLOSS_Sysargs *args);
+static void recordSyscall(int syscallNum, USLOSS_Sysargs *sysargs, int start);
 void clockIntHandler(int dev, void *payload);
 void diskIntHandler(int dev, void *unit);
 void termIntHandler(int dev, void *unit);
@@ -66,6 +68,16 @@ int termIntBox[4];
 static struct Mailbox mailboxes[MAXMBOX];
 static struct MailSlot mailSlots[MAXSLOTS];
 static struct ShadowProcess shadowProcTable[MAXPROC];
+static struct SyscallStats syscallStats[MAXSYSCALLS];
+
+// Syscalls whose handler returns a status in arg4, negative on error. The others leave arg4 alone or return a
+// value in it (GetPID, GetTimeofDay), so only these are counted as errors.
+static const char syscallReportsStatus[MAXSYSCALLS] = {
+    [SYS_TERMREAD] = 1, [SYS_TERMWRITE] = 1, [SYS_SPAWN] = 1, [SYS_WAIT] = 1, [SYS_SLEEP] = 1,
+    [SYS_DISKREAD] = 1, [SYS_DISKWRITE] = 1, [SYS_DISKSIZE] = 1, [SYS_SEMCREATE] = 1, [SYS_SEMP] = 1,
+    [SYS_SEMV] = 1, [SYS_SEMFREE] = 1, [SYS_SEMSTATS] = 1, [SYS_SEMTIMEDP] = 1, [SYS_SYSCALLSTATS] = 1,
+    [SYS_DISKASYNC] = 1, [SYS_DISKIOV] = 1, [SYS_DISKSYNC] = 1, [SYS_DEVICESTATS] = 1,
+};
 
 // Global arrays for system calls and interrupts
 void (*systemCallVec[MAXSYSCALLS])(USLOSS_Sysargs *args);
@@ -90,6 +102,7 @@ void phase2_init(void) {
     memset(mailboxes, 0, sizeof(mailboxes));
     memset(mailSlots, 0, sizeof(mailSlots));
     memset(shadowProcTable, 0, sizeof(shadowProcTable));
+    memset(syscallStats, 0, sizeof(syscallStats));
 
     // Create 7 mailboxes for interrupts
     clockIntBox = MboxCreate(0, sizeof(int));  // mailbox id for clock interrupt
@@ -123,6 +136,7 @@ void phase2_init(void) {
     // Initialize the system call vector
     for (int i = 0; i < MAXSYSCALLS; i++) {
         systemCallVec[i] = nullSys;    }
+    systemCallVec[SYS_SYSCALLSTATS] = syscallStatsSys;
 
     USLOSS_IntVec[0] = clockIntHandler;
     USLOSS_IntVec[2] = diskIntHandler;
@@ -545,8 +559,93 @@ static void syscallHandler(int dev, void *args) {
         USLOSS_Halt(1);
     }
     
-    // call the appropriate system call function -- should call a nullSys and halt simulation for now
+    // call the appropriate system call function, timing it for the stats
+    int start = currentTime();
     systemCallVec[syscallNum](sysargs);
+    recordSyscall(syscallNum, sysargs, start);
+}
+
+/**************
+* Function: recordSyscall
+* Parameters: int syscallNum, USLOSS_Sysargs *sysargs, int start
+* Returns: void
+* Description: Counts one finished syscall, and an error if it is one that reports a status in arg4 and that status
+*              is negative. Returning from the syscall interrupt restores the caller's mode, so
+*              handlers should return in kernel mode. One that drops to user mode can't have its end time read (the
+*              clock is privileged), so it is counted as unmeasured instead of being timed.
+***************/
+static void recordSyscall(int syscallNum, USLOSS_Sysargs *sysargs, int start) {
+    SyscallStats *stats = &syscallStats[syscallNum];
+    stats->calls++;
+    if (syscallReportsStatus[syscallNum] && (long)sysargs->arg4 < 0) {
+        stats->errors++;
+    }
+    if (!(USLOSS_PsrGet() & USLOSS_PSR_CURRENT_MODE)) {
+        stats->unmeasured++;
+        return;
+    }
+
+    int latency = currentTime() - start;
+    stats->totalLatency += latency;
+    if (latency > stats->maxLatency) {
+        stats->maxLatency = latency;
+    }
+    int bucket = 0;
+    while (latency > 1 && bucket < SYSCALL_LATENCY_BUCKETS - 1) {
+        latency >>= 1;
+        bucket++;
+    }
+    stats->histogram[bucket]++;
+}
+
+/**************
+* Function: syscallStatsSys
+* Parameters: USLOSS_Sysargs *args
+* Returns: void
+* Description: Handler for SYS_SYSCALLSTATS. Copies the counters for syscall numbers 0 through arg2-1 (at most
+*              MAXSYSCALLS) into the array at arg1 and returns the number of entries copied in arg2.
+***************/
+static void syscallStatsSys(USLOSS_Sysargs *args) {
+    SyscallStats *out = (SyscallStats*)args->arg1;
+    int count = (int)(long)args->arg2;
+    if (out == NULL || count < 0) {
+        args->arg2 = 0;
+        args->arg4 = (void*)(long)-1;
+        return;
+    }
+
+    if (count > MAXSYSCALLS) {
+        count = MAXSYSCALLS;
+    }
+    memcpy(out, syscallStats, count * sizeof(SyscallStats));
+    args->arg2 = (void*)(long)count;
+    args->arg4 = 0;
+}
+
+/**************
+* Function: dumpSyscallStats
+* Parameters: void
+* Returns: void
+* Description: Prints the counters and the non-empty latency buckets (as lower bound:count) of every syscall that
+*              has been called at least once.
+***************/
+void dumpSyscallStats(void) {
+    USLOSS_Console(" SYS  CALLS  ERRORS  UNMEAS  AVG(us)  MAX(us)  LATENCY HISTOGRAM (>=us:count)\n");
+    for (int i = 0; i < MAXSYSCALLS; i++) {
+        SyscallStats *stats = &syscallStats[i];
+        if (stats->calls == 0) {
+            continue;
+        }
+        int measured = stats->calls - stats->unmeasured;
+        USLOSS_Console("%4d %6d %7d %7d %8d %8d ", i, stats->calls, stats->errors, stats->unmeasured,
+                       measured > 0 ? stats->totalLatency / measured : 0, stats->maxLatency);
+        for (int j = 0; j < SYSCALL_LATENCY_BUCKETS; j++) {
+            if (stats->histogram[j] != 0) {
+                USLOSS_Console(" %d:%d", j == 0 ? 0 : 1 << j, stats->histogram[j]);
+            }
+        }
+        USLOSS_Console("\n");
+    }
 }
 
 /**************
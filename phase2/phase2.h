@@ -44,4 +44,21 @@ extern void wakeupByDevice(int type, int unit, int status);
 // 
 extern void (*systemCallVec[])(USLOSS_Sysargs *args);
 
+// Per-syscall counters kept by the syscall handler. Latencies are in
+// microseconds; histogram bucket i counts calls that took [2^i, 2^(i+1)) us,
+// except bucket 0 also holds 0-1us and the last bucket has no upper bound.
+#define SYSCALL_LATENCY_BUCKETS 20
+
+typedef struct SyscallStats {
+    int calls;
+    int errors;       // calls that returned a negative status in arg4, for syscalls that report one
+    int unmeasured;   // calls that returned in user mode, so no end time
+    int totalLatency;
+    int maxLatency;
+    int histogram[SYSCALL_LATENCY_BUCKETS];
+} SyscallStats;
+
+// prints a line for every syscall number that has been called
+extern void dumpSyscallStats(void);
+
 #endif
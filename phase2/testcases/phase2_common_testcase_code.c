@@ -73,6 +73,10 @@ void phase5_start_service_processes()
 void finish(int argc, char **argv)
 {
     USLOSS_Console("%s(): The simulation is now terminating.\n", __func__);
+#ifdef SYSCALL_STATS
+    // build with -DSYSCALL_STATS to get the per-syscall counters at exit
+    dumpSyscallStats();
+#endif
 }
 
 void test_setup  (int argc, char **argv) {}
@@ -0,0 +1,88 @@
+
+/* A test of the per-syscall statistics.  Installs a handler for SYS_SEMP
+ * that returns its first argument as the status, calls it three times from
+ * user mode (once with an error status), then reads the counters back with
+ * SYS_SYSCALLSTATS.  The same handler on SYS_GETPID returns a value rather
+ * than a status, so a negative one there is not counted as an error.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+extern void USLOSS_Syscall(void *arg);
+
+SyscallStats stats[MAXSYSCALLS];
+
+
+
+void echoStatus(USLOSS_Sysargs *args)
+{
+    args->arg4 = args->arg1;
+}
+
+
+
+void enableUserMode(){
+    int result;
+
+    result = USLOSS_PsrSet( USLOSS_PsrGet() & (~ USLOSS_PSR_CURRENT_MODE) );
+    if ( result != USLOSS_DEV_OK ) {
+        USLOSS_Console("enableUserMode(): USLOSS_PsrSet returned %d ", result);
+        USLOSS_Console("Halting...\n");
+        USLOSS_Halt(1);
+    }
+}
+
+
+
+int start2(void *arg)
+{
+    USLOSS_Sysargs args;
+    int i, bucketTotal;
+
+    systemCallVec[SYS_SEMP] = echoStatus;
+    systemCallVec[SYS_GETPID] = echoStatus;
+
+    USLOSS_Console("start2(): putting itself into user mode\n");
+    enableUserMode();
+
+    USLOSS_Console("start2(): calling SYS_SEMP three times, once with status -1\n");
+    for (i = 0; i < 3; i++) {
+        args.number = SYS_SEMP;
+        args.arg1 = (void *)(long)(i == 1 ? -1 : 0);
+        USLOSS_Syscall((void *)&args);
+    }
+
+    USLOSS_Console("start2(): calling SYS_GETPID once, returning -1\n");
+    args.number = SYS_GETPID;
+    args.arg1 = (void *)-1L;
+    USLOSS_Syscall((void *)&args);
+
+    args.number = SYS_SYSCALLSTATS;
+    args.arg1 = stats;
+    args.arg2 = (void *)(long)MAXSYSCALLS;
+    USLOSS_Syscall((void *)&args);
+    USLOSS_Console("start2(): SYS_SYSCALLSTATS returned %d, copied %d entries\n",
+                   (int)(long)args.arg4, (int)(long)args.arg2);
+
+    bucketTotal = 0;
+    for (i = 0; i < SYSCALL_LATENCY_BUCKETS; i++) {
+        bucketTotal += stats[SYS_SEMP].histogram[i];
+    }
+    USLOSS_Console("start2(): SYS_SEMP: calls %d, errors %d, unmeasured %d, histogram total %d\n",
+                   stats[SYS_SEMP].calls, stats[SYS_SEMP].errors, stats[SYS_SEMP].unmeasured, bucketTotal);
+    USLOSS_Console("start2(): SYS_GETPID: calls %d, errors %d\n",
+                   stats[SYS_GETPID].calls, stats[SYS_GETPID].errors);
+    USLOSS_Console("start2(): SYS_SEMV: calls %d\n", stats[SYS_SEMV].calls);
+
+    args.number = SYS_SYSCALLSTATS;
+    args.arg1 = NULL;
+    USLOSS_Syscall((void *)&args);
+    USLOSS_Console("start2(): SYS_SYSCALLSTATS with a NULL buffer returned %d\n", (int)(long)args.arg4);
+
+    USLOSS_Halt(0);
+    return 0; /* so gcc will not complain about its absence... */
+}
+
@@ -0,0 +1,88 @@
+
+/* A test that a syscall which blocks in its handler is timed.  The handler
+ * for syscall 10 waits on a mailbox the way the phase 3 semaphore handlers
+ * do; a lower-priority child spins for at least 100us before waking it.
+ * The call must show up in the latency histogram, not as unmeasured.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+extern void USLOSS_Syscall(void *arg);
+
+SyscallStats stats[MAXSYSCALLS];
+int wakeBox;
+
+
+
+void blockingSys(USLOSS_Sysargs *args)
+{
+    MboxRecv(wakeBox, NULL, 0);
+    args->arg4 = 0;
+}
+
+
+
+int Waker(void *arg)
+{
+    int start = currentTime();
+
+    while (currentTime() - start < 100)
+        ;
+    USLOSS_Console("Waker(): waking start2\n");
+    MboxSend(wakeBox, NULL, 0);
+    return 0;
+}
+
+
+
+void enableUserMode(){
+    int result;
+
+    result = USLOSS_PsrSet( USLOSS_PsrGet() & (~ USLOSS_PSR_CURRENT_MODE) );
+    if ( result != USLOSS_DEV_OK ) {
+        USLOSS_Console("enableUserMode(): USLOSS_PsrSet returned %d ", result);
+        USLOSS_Console("Halting...\n");
+        USLOSS_Halt(1);
+    }
+}
+
+
+
+int start2(void *arg)
+{
+    USLOSS_Sysargs args;
+    int i, bucketTotal;
+
+    systemCallVec[10] = blockingSys;
+    wakeBox = MboxCreate(0, 0);
+    spork("Waker", Waker, NULL, USLOSS_MIN_STACK, 4);
+
+    USLOSS_Console("start2(): putting itself into user mode\n");
+    enableUserMode();
+
+    USLOSS_Console("start2(): calling syscall 10, which blocks until Waker runs\n");
+    args.number = 10;
+    USLOSS_Syscall((void *)&args);
+    USLOSS_Console("start2(): syscall 10 returned\n");
+
+    args.number = SYS_SYSCALLSTATS;
+    args.arg1 = stats;
+    args.arg2 = (void *)(long)MAXSYSCALLS;
+    USLOSS_Syscall((void *)&args);
+
+    bucketTotal = 0;
+    for (i = 0; i < SYSCALL_LATENCY_BUCKETS; i++) {
+        bucketTotal += stats[10].histogram[i];
+    }
+    USLOSS_Console("start2(): syscall 10: calls %d, unmeasured %d, histogram total %d\n",
+                   stats[10].calls, stats[10].unmeasured, bucketTotal);
+    USLOSS_Console("start2(): syscall 10 took at least 100us: %s\n",
+                   stats[10].maxLatency >= 100 ? "yes" : "no");
+
+    USLOSS_Halt(0);
+    return 0; /* so gcc will not complain about its absence... */
+}
+
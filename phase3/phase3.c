@@ -5,6 +5,7 @@
 #include <usloss.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <string.h>
 
 typedef struct ShadowProcess {
@@ -13,17 +14,32 @@ typedef struct ShadowProcess {
     int (*func)(void *);
     int *arg;
     int lock;
+    int wakeBox;     // private mailbox a blocked SemP waits on
+    int wakeStatus;  // 0 if woken by SemV, -1 if the semaphore was freed
     struct ShadowProcess *next;
+    int deadline;    // currentTime() at which a timed SemP gives up
+    int timedOut;    // set by the clock handler when it posts a timeout wakeup
+    int onTimerList;
+    struct ShadowProcess *nextTimer;
+    struct ShadowProcess *prevTimer;
+    int timerBucket;
 } ShadowProcess;
 
+// Timed SemP waiters hang off a hashed timing wheel with a bucket per clock tick, deadline / SEM_TIMER_TICK_US
+// modulo SEM_TIMER_BUCKETS. Adding and cancelling take constant time, and each tick only looks at the buckets the
+// clock has reached; a waiter more than a full turn out just stays put until its own turn comes round.
+#define SEM_TIMER_TICK_US   (USLOSS_CLOCK_MS * 1000)
+#define SEM_TIMER_BUCKETS   64
+
 typedef struct Sem {
     int slot;
     int inUse;
     int start;
     int currVal;
-    struct ShadowProcess *Process;
+    struct ShadowProcess *Process;  // queue of processes blocked in SemP
     int mutex;
-    int prev;
+    SemStats stats;
+    struct Sem *nextFree;
 } Sem;
 
 // prototypes
@@ -33,16 +49,47 @@ void Kernel_Wait(USLOSS_Sysargs *args);
 void Kernel_Terminate(USLOSS_Sysargs *args);
 void Kernel_SemCreate(USLOSS_Sysargs *args);
 void Kernel_SemP(USLOSS_Sysargs *args);
+void Kernel_SemTimedP(USLOSS_Sysargs *args);
 void Kernel_SemV(USLOSS_Sysargs *args);
+void Kernel_SemFree(USLOSS_Sysargs *args);
 void Kernel_GetTimeofDay(USLOSS_Sysargs *args);
 void Kernel_GetPID(USLOSS_Sysargs *args);
+void Kernel_SemStats(USLOSS_Sysargs *args);
+void dumpSemaphores(int topN);
+static int collectHotSemaphores(SemStats *out, int maxCount);
+static int semAcquire(int val, int timeout);
+static int semLock(int sem);
+static int validSem(int sem);
+static ShadowProcess *semEnqueue(Sem *sem);
+static ShadowProcess *semDequeue(Sem *sem);
+static int semRemove(Sem *sem, ShadowProcess *proc);
+static void semTimerAdd(ShadowProcess *proc, int deadline);
+static void semTimerUnlink(ShadowProcess *proc);
+static void semTimerCancel(ShadowProcess *proc);
+static void semTimerExpire(int now);
+static int disableInterrupts(void);
+static void restoreInterrupts(int psr);
+static void recordAcquire(ContentionStats *stats, int contended, int waited);
+static void recordTopWaiter(SemStats *stats, int pid, int waited);
+void kernelInfoRefresh(void);
+static void kernelInfoIntHandler(int dev, void *arg);
 
 // Global arrays
 static struct ShadowProcess shadowProcTable[MAXPROC];
 static struct Sem semaphoreTable[MAXSEMS];
 
+// Interrupt handlers installed by phase2, wrapped by kernelInfoIntHandler
+static void (*phase2IntVec[USLOSS_NUM_INTS])(int dev, void *arg);
+
 // Global variables
 int semaphoreCount;
+static Sem *freeSems;
+static ShadowProcess *semTimers[SEM_TIMER_BUCKETS];  // timed SemP waiters, by deadline tick
+static int semTimerTick;                               // tick the clock handler has expired up to
+
+// Kernel info page, read directly by the user-mode library
+static KernelInfo kernelInfoData;
+const volatile KernelInfo *kernelInfo = &kernelInfoData;
 
 /**************
 * Function: phase3_init
@@ -57,14 +104,39 @@ void phase3_init() {
     memset(semaphoreTable, 0, sizeof(semaphoreTable));
     memset(shadowProcTable, 0, sizeof(shadowProcTable));
 
+    // every slot starts on the free list
+    freeSems = NULL;
+    memset(semTimers, 0, sizeof(semTimers));
+    semTimerTick = 0;
+    for(int i=MAXSEMS-1; i>=0; i--) {
+        semaphoreTable[i].slot = i;
+        semaphoreTable[i].nextFree = freeSems;
+        freeSems = &semaphoreTable[i];
+    }
+    for(int i=0; i<MAXPROC; i++) {
+        shadowProcTable[i].wakeBox = -1;
+    }
+
     systemCallVec[SYS_SPAWN] = (void *) Kernel_Spawn;
     systemCallVec[SYS_WAIT] = (void *) Kernel_Wait;
     systemCallVec[SYS_TERMINATE] = (void *) Kernel_Terminate;
     systemCallVec[SYS_SEMCREATE] = (void *) Kernel_SemCreate;
     systemCallVec[SYS_SEMP] = (void *) Kernel_SemP;
+    systemCallVec[SYS_SEMTIMEDP] = (void *) Kernel_SemTimedP;
     systemCallVec[SYS_SEMV] = (void *) Kernel_SemV;
+    systemCallVec[SYS_SEMFREE] = (void *) Kernel_SemFree;
     systemCallVec[SYS_GETPID] = (void *) Kernel_GetPID;
     systemCallVec[SYS_GETTIMEOFDAY] = (void *) Kernel_GetTimeofDay;
+    systemCallVec[SYS_SEMSTATS] = (void *) Kernel_SemStats;
+
+    // Every return to user mode goes through one of these handlers (or
+    // through Spawn_Helper), so wrapping them keeps the info page current
+    memset(&kernelInfoData, 0, sizeof(kernelInfoData));
+    int ints[] = { USLOSS_CLOCK_INT, USLOSS_DISK_INT, USLOSS_TERM_INT, USLOSS_SYSCALL_INT };
+    for(int i=0; i<4; i++) {
+        phase2IntVec[ints[i]] = USLOSS_IntVec[ints[i]];
+        USLOSS_IntVec[ints[i]] = kernelInfoIntHandler;
+    }
 }
 
 void phase3_start_service_processes() {
@@ -96,8 +168,6 @@ void Kernel_Spawn(USLOSS_Sysargs *args) {
         MboxSend(shadowProcTable[childPid % MAXPROC].lock, 0, 0);
     }
 
-    USLOSS_PsrSet(USLOSS_PsrGet() & ~USLOSS_PSR_CURRENT_MODE);
-
     args->arg1 = (void*)(long)childPid;
     args->arg4 = (void*)(long)0;
 }
@@ -117,6 +187,9 @@ int Spawn_Helper(void *args) {
     int (*_func)(void*) = shadowProcTable[pid % MAXPROC].func;
     void *_arg = args;
 
+    // first time this process reaches user mode
+    kernelInfoRefresh();
+
     // Enter user mode here
     USLOSS_PsrSet(USLOSS_PsrGet() & ~USLOSS_PSR_CURRENT_MODE);
 
@@ -134,8 +207,6 @@ void Kernel_Wait(USLOSS_Sysargs *args) {
     args->arg1 = (void*)(long)pid;
     args->arg2 = (void*)(long)status;
     args->arg4 = (void*)(long)0;
-
-    USLOSS_PsrSet(USLOSS_PsrGet() & ~USLOSS_PSR_CURRENT_MODE);
 }
 
 void Kernel_Terminate(USLOSS_Sysargs *args) {
@@ -150,103 +221,130 @@ void Kernel_Terminate(USLOSS_Sysargs *args) {
     }
     
     quit(status);
-    // make sure we are in user mode
-    USLOSS_PsrSet(USLOSS_PsrGet() & ~USLOSS_PSR_CURRENT_MODE);
 }
 
+/**************
+* Function: Kernel_SemCreate
+* Parameters: USLOSS_Sysargs *args
+* Returns: void
+* Description: Takes a slot off the free list and gives it a mutex mailbox. Returns the semaphore id in arg1, or -1
+*              in arg4 if the initial value is negative or no slot or mailbox is left.
+***************/
 void Kernel_SemCreate(USLOSS_Sysargs *args) {
     // make sure we are in kernel mode
     int val = (long)args->arg1;
-    if(val < 0 || semaphoreCount == MAXSEMS) {
+    int mutex = -1;
+    if(val < 0 || freeSems == NULL || (mutex = MboxCreate(1, 0)) < 0) {
         args->arg4 = (void*)(long)-1;
     }
     else {
+        Sem *sem = freeSems;
+        freeSems = sem->nextFree;
         semaphoreCount++;
-        int prev = MboxCreate(val, 0);
-        int mutex = MboxCreate(1, 0);
-        MboxSend(mutex, NULL, 0);
-        int i;
-        for(i=0; i<MAXSEMS; i++) {
-            if(semaphoreTable[i].inUse == 0) {
-                semaphoreTable[i].inUse = 1;
-                semaphoreTable[i].slot = i;
-                semaphoreTable[i].start = val;
-                semaphoreTable[i].currVal = val;
-                semaphoreTable[i].prev = prev;
-                semaphoreTable[i].mutex = mutex;
-                break;
-            }
-        }
 
-        // DON'T DO THIS. Don't fill up prev with a bunch of messages. Do not use messages as tokens. 
-        // Only use mailbox only for wakeup
-        int j;
-        for(j=0; j<val; j++) {
-            MboxSend(prev, NULL, 0);
-        }
-        MboxRecv(mutex, NULL, 0);
-        args->arg1 = (void*)(long)semaphoreTable[i].slot;
+        sem->inUse = 1;
+        sem->start = val;
+        sem->currVal = val;
+        sem->Process = NULL;
+        sem->mutex = mutex;
+        sem->nextFree = NULL;
+        memset(&sem->stats, 0, sizeof(SemStats));
+        sem->stats.semaphore = sem->slot;
+
+        args->arg1 = (void*)(long)sem->slot;
         args->arg4 = 0;
     }
-
-    // put into user mode
-    USLOSS_PsrSet(USLOSS_PsrGet() & ~USLOSS_PSR_CURRENT_MODE);
 }
 
+/**************
+* Function: Kernel_SemP
+* Parameters: USLOSS_Sysargs *args
+* Returns: void
+* Description: Decrements the semaphore, or waits in its queue until a SemV hands this process a unit. Returns -1 in
+*              arg4 if the semaphore is invalid or is freed while we wait.
+***************/
 void Kernel_SemP(USLOSS_Sysargs *args) {
     int val = (long)args->arg1;
-    if(val < 0) {
-        printf("Semaphore does not exist | setting it to invalid\n");
+    args->arg4 = (void*)(long)semAcquire(val, -1);
+}
+
+/**************
+* Function: Kernel_SemTimedP
+* Parameters: USLOSS_Sysargs *args
+* Returns: void
+* Description: Like Kernel_SemP, but gives up after arg2 milliseconds. A timeout of 0 never blocks. Returns 0 in
+*              arg4 if the semaphore was decremented, 1 if the timeout expired first, or -1 as for SemP. A negative
+*              timeout, or one whose deadline is past what currentTime() can count to, is also -1.
+***************/
+void Kernel_SemTimedP(USLOSS_Sysargs *args) {
+    int val = (long)args->arg1;
+    int timeout = (int)(long)args->arg2;
+    if(timeout < 0 || currentTime() + timeout * 1000LL > INT_MAX) {
         args->arg4 = (void*)(long)-1;
     }
     else {
-        args->arg4 = 0;  // set as valid
-        MboxSend(semaphoreTable[val].mutex, NULL, 0);
-        if(semaphoreTable[val].currVal == 0) {
-            // add current process to blocked processes queue
-            MboxRecv(semaphoreTable[val].mutex, NULL, 0);  // release mutex
-            MboxRecv(semaphoreTable[val].prev, NULL, 0);
-            MboxSend(semaphoreTable[val].mutex, NULL, 0);
-        }
-        else {
-            printf("P'ing semaphore %d\n", val);
-            semaphoreTable[val].currVal--;
-            MboxRecv(semaphoreTable[val].prev, NULL, 0);
-        }
-        MboxRecv(semaphoreTable[val].mutex, NULL, 0);
+        args->arg4 = (void*)(long)semAcquire(val, timeout);
     }
-
-
-    USLOSS_PsrSet(USLOSS_PsrGet() & ~USLOSS_PSR_CURRENT_MODE);
 }
 
+/**************
+* Function: Kernel_SemV
+* Parameters: USLOSS_Sysargs *args
+* Returns: void
+* Description: Hands a unit directly to the first blocked waiter, or increments the semaphore if nobody is waiting.
+***************/
 void Kernel_SemV(USLOSS_Sysargs *args) {
     int val = (long)args->arg1;
-    if(val<0) {
+    if(!validSem(val) || semLock(val) < 0) {
         args->arg4 = (void*)(long)-1;
     }
     else {
+        Sem *sem = &semaphoreTable[val];
+        if(sem->Process != NULL) {
+            // Dequeue the process and wake it up
+            ShadowProcess *waiter = semDequeue(sem);
+            waiter->wakeStatus = 0;
+            MboxSend(waiter->wakeBox, NULL, 0);
+        }
+        else {
+            sem->currVal++;
+        }
+        MboxRecv(sem->mutex, NULL, 0);
         args->arg4 = 0;
     }
-    MboxSend(semaphoreTable[val].mutex, NULL, 0);
-    if(semaphoreTable[val].Process != NULL) {
-        // Dequeue the process
-        MboxRecv(semaphoreTable[val].mutex, NULL, 0);
-        MboxSend(semaphoreTable[val].prev, NULL, 0);
-        MboxSend(semaphoreTable[val].mutex, NULL, 0);
+}
+
+/**************
+* Function: Kernel_SemFree
+* Parameters: USLOSS_Sysargs *args
+* Returns: void
+* Description: Frees a semaphore. Every process blocked in SemP is woken and its SemP returns -1, the mutex mailbox
+*              is released (failing anyone still waiting for it) and the slot goes back on the free list. Returns
+*              -1 in arg4 for an invalid semaphore, 1 if there were blocked waiters, or 0 otherwise.
+***************/
+void Kernel_SemFree(USLOSS_Sysargs *args) {
+    int val = (long)args->arg1;
+    if(!validSem(val) || semLock(val) < 0) {
+        args->arg4 = (void*)(long)-1;
     }
     else {
-        printf("V'ing semaphore %d\n", val);
-        semaphoreTable[val].currVal++;
+        Sem *sem = &semaphoreTable[val];
+        int hadWaiters = (sem->Process != NULL);
+        while(sem->Process != NULL) {
+            ShadowProcess *waiter = semDequeue(sem);
+            waiter->wakeStatus = -1;
+            MboxSend(waiter->wakeBox, NULL, 0);
+        }
 
-        // need to wake up blocked process
-        MboxRecv(semaphoreTable[val].mutex, NULL, 0);
-        MboxSend(semaphoreTable[val].mutex, NULL, 0);
+        sem->inUse = 0;
+        MboxRelease(sem->mutex);
+        sem->mutex = -1;
+        sem->nextFree = freeSems;
+        freeSems = sem;
+        semaphoreCount--;
 
+        args->arg4 = (void*)(long)hadWaiters;
     }
-    MboxRecv(semaphoreTable[val].mutex, NULL, 0);
-
-    USLOSS_PsrSet(USLOSS_PsrGet() & ~USLOSS_PSR_CURRENT_MODE);
 }
 
 void Kernel_GetTimeofDay(USLOSS_Sysargs *args) {
@@ -257,4 +355,405 @@ void Kernel_GetTimeofDay(USLOSS_Sysargs *args) {
 void Kernel_GetPID(USLOSS_Sysargs *args) {
     // make sure we are in kernel mode
     args->arg1 = getpid();
-}
\ No newline at end of file
+}
+
+/**************
+* Function: Kernel_SemStats
+* Parameters: USLOSS_Sysargs *args
+* Returns: void
+* Description: Copies the contention counters of the hottest semaphores into the caller's array (arg1), up to arg2
+*              entries, hottest first. The number of entries copied is returned in arg2.
+***************/
+void Kernel_SemStats(USLOSS_Sysargs *args) {
+    SemStats *stats = (SemStats*)args->arg1;
+    int maxCount = (int)(long)args->arg2;
+    if(stats == NULL || maxCount < 0) {
+        args->arg2 = 0;
+        args->arg4 = (void*)(long)-1;
+    }
+    else {
+        args->arg2 = (void*)(long)collectHotSemaphores(stats, maxCount);
+        args->arg4 = 0;
+    }
+}
+
+/**************
+* Function: dumpSemaphores
+* Parameters: int topN
+* Returns: void
+* Description: Prints the topN hottest semaphores to the console, in the style of dumpProcesses(). Semaphores are
+*              ranked by the total time processes spent waiting on them or on their lock.
+***************/
+void dumpSemaphores(int topN) {
+    static SemStats hot[MAXSEMS];  // too big for a kernel stack
+    if(topN > MAXSEMS) {
+        topN = MAXSEMS;
+    }
+    int count = collectHotSemaphores(hot, topN);
+
+    USLOSS_Console(" SEM  ACQ  CONT  WAIT(us)  MAXWAIT  LOCK-ACQ  LOCK-CONT  LOCK-WAIT  LONGEST WAITERS (pid:us)\n");
+    for(int i=0; i<count; i++) {
+        SemStats *s = &hot[i];
+        USLOSS_Console("%4d %4d %5d %9d %8d %9d %10d %10d ", s->semaphore, s->sem.acquisitions, s->sem.contended,
+                       s->sem.totalWait, s->sem.maxWait, s->lock.acquisitions, s->lock.contended, s->lock.totalWait);
+        for(int j=0; j<SEMSTATS_TOP_WAITERS && s->topWaiterPid[j] != 0; j++) {
+            USLOSS_Console(" %d:%d", s->topWaiterPid[j], s->topWaiterTime[j]);
+        }
+        USLOSS_Console("\n");
+    }
+}
+
+/**************
+* Function: collectHotSemaphores
+* Parameters: SemStats *out, int maxCount
+* Returns: int
+* Description: Fills out with the stats of up to maxCount semaphores that have been used, hottest first, and returns
+*              how many were copied. Heat is the total wait on the semaphore plus its lock; ties go to the semaphore
+*              with more contended acquires.
+***************/
+static int collectHotSemaphores(SemStats *out, int maxCount) {
+    int count = 0;
+    for(int i=0; i<MAXSEMS && maxCount > 0; i++) {
+        SemStats *s = &semaphoreTable[i].stats;
+        if(!semaphoreTable[i].inUse || (s->sem.acquisitions == 0 && s->lock.acquisitions == 0)) {
+            continue;
+        }
+
+        // insertion sort into out, dropping the coldest entry once it is full
+        int heat = s->sem.totalWait + s->lock.totalWait;
+        int j = count;
+        if(count == maxCount) {
+            j = maxCount - 1;
+            if(heat <= out[j].sem.totalWait + out[j].lock.totalWait) {
+                continue;
+            }
+        }
+        else {
+            count++;
+        }
+        while(j > 0) {
+            int prevHeat = out[j-1].sem.totalWait + out[j-1].lock.totalWait;
+            if(prevHeat > heat || (prevHeat == heat && out[j-1].sem.contended >= s->sem.contended)) {
+                break;
+            }
+            out[j] = out[j-1];
+            j--;
+        }
+        out[j] = *s;
+    }
+    return count;
+}
+
+/**************
+* Function: semAcquire
+* Parameters: int val, int timeout
+* Returns: int
+* Description: Shared body of SemP and SemTimedP. A negative timeout waits forever, otherwise the process is also put
+*              on the timer list that the clock interrupt checks. The clock handler only posts a wakeup; the waiter
+*              itself takes the mutex and works out whether SemV got to it first. Returns 0 once the semaphore is
+*              decremented, 1 on timeout, -1 if the semaphore is invalid or freed.
+***************/
+static int semAcquire(int val, int timeout) {
+    if(!validSem(val) || semLock(val) < 0) {
+        return -1;
+    }
+
+    Sem *sem = &semaphoreTable[val];
+    if(sem->currVal > 0) {
+        sem->currVal--;
+        recordAcquire(&sem->stats.sem, 0, 0);
+        MboxRecv(sem->mutex, NULL, 0);
+        return 0;
+    }
+    if(timeout == 0) {
+        MboxRecv(sem->mutex, NULL, 0);
+        return 1;
+    }
+
+    // add current process to blocked processes queue, then wait for a wakeup
+    int start = currentTime();
+    ShadowProcess *me = semEnqueue(sem);
+    me->timedOut = 0;
+    if(timeout > 0) {
+        semTimerAdd(me, start + timeout * 1000);
+    }
+    MboxRecv(sem->mutex, NULL, 0);  // release mutex
+    MboxRecv(me->wakeBox, NULL, 0);
+    int waited = currentTime() - start;
+
+    if(timeout > 0) {
+        semTimerCancel(me);
+
+        // Still queued means nobody handed us a unit, so this was the timer. The slot may have been freed and
+        // reused meanwhile; we are then not in the new semaphore's queue and fall through like any other wakeup.
+        int locked = (semLock(val) == 0);
+        if(locked && semRemove(sem, me)) {
+            MboxRecv(sem->mutex, NULL, 0);
+            return 1;
+        }
+        if(locked) {
+            MboxRecv(sem->mutex, NULL, 0);
+        }
+
+        // SemV or SemFree dequeued us too; take whichever of the two wakeups is still outstanding
+        if(me->timedOut) {
+            MboxRecv(me->wakeBox, NULL, 0);
+        }
+    }
+
+    if(me->wakeStatus < 0) {
+        return -1;
+    }
+    recordAcquire(&sem->stats.sem, 1, waited);
+    recordTopWaiter(&sem->stats, me->pid, waited);
+    return 0;
+}
+
+/**************
+* Function: semLock
+* Parameters: int sem
+* Returns: int
+* Description: Acquires the mutex that guards a semaphore, recording whether the caller had to wait for it. Returns
+*              -1 if the semaphore was freed while we waited, 0 otherwise.
+***************/
+static int semLock(int sem) {
+    ContentionStats *lock = &semaphoreTable[sem].stats.lock;
+    if(MboxCondSend(semaphoreTable[sem].mutex, NULL, 0) == 0) {
+        recordAcquire(lock, 0, 0);
+        return 0;
+    }
+
+    int start = currentTime();
+    if(MboxSend(semaphoreTable[sem].mutex, NULL, 0) < 0) {
+        return -1;
+    }
+    recordAcquire(lock, 1, currentTime() - start);
+    return 0;
+}
+
+static int validSem(int sem) {
+    return sem >= 0 && sem < MAXSEMS && semaphoreTable[sem].inUse;
+}
+
+/**************
+* Function: semEnqueue
+* Parameters: Sem *sem
+* Returns: ShadowProcess *
+* Description: Adds the current process to the end of the semaphore's wait queue. Must hold the semaphore's mutex.
+*              The process's private wakeup mailbox is created the first time it ever blocks.
+***************/
+static ShadowProcess *semEnqueue(Sem *sem) {
+    int pid = getpid();
+    ShadowProcess *me = &shadowProcTable[pid % MAXPROC];
+    me->pid = pid;
+    me->next = NULL;
+    if(me->wakeBox < 0) {
+        me->wakeBox = MboxCreate(1, 0);
+    }
+
+    if(sem->Process == NULL) {
+        sem->Process = me;
+    }
+    else {
+        ShadowProcess *tmp = sem->Process;
+        while(tmp->next != NULL) {
+            tmp = tmp->next;
+        }
+        tmp->next = me;
+    }
+    return me;
+}
+
+static ShadowProcess *semDequeue(Sem *sem) {
+    ShadowProcess *waiter = sem->Process;
+    sem->Process = waiter->next;
+    waiter->next = NULL;
+    return waiter;
+}
+
+/**************
+* Function: semRemove
+* Parameters: Sem *sem, ShadowProcess *proc
+* Returns: int
+* Description: Unlinks proc from the semaphore's wait queue. Must hold the semaphore's mutex. Returns 1 if proc was
+*              queued, 0 if it was not.
+***************/
+static int semRemove(Sem *sem, ShadowProcess *proc) {
+    ShadowProcess **link = &sem->Process;
+    while(*link != NULL && *link != proc) {
+        link = &(*link)->next;
+    }
+    if(*link == NULL) {
+        return 0;
+    }
+    *link = proc->next;
+    proc->next = NULL;
+    return 1;
+}
+
+/**************
+* Function: semTimerAdd
+* Parameters: ShadowProcess *proc, int deadline
+* Returns: void
+* Description: Puts proc in the timer bucket of its deadline's tick. A deadline in a tick the clock handler has
+*              already passed goes in the current one. The buckets are shared with the clock interrupt handler, so
+*              interrupts are off while they are changed.
+***************/
+static void semTimerAdd(ShadowProcess *proc, int deadline) {
+    int psr = disableInterrupts();
+    proc->deadline = deadline;
+    proc->onTimerList = 1;
+
+    int tick = deadline / SEM_TIMER_TICK_US;
+    if(tick < semTimerTick) {
+        tick = semTimerTick;
+    }
+    proc->timerBucket = tick % SEM_TIMER_BUCKETS;
+    ShadowProcess **bucket = &semTimers[proc->timerBucket];
+    proc->prevTimer = NULL;
+    proc->nextTimer = *bucket;
+    if(*bucket != NULL) {
+        (*bucket)->prevTimer = proc;
+    }
+    *bucket = proc;
+    restoreInterrupts(psr);
+}
+
+/**************
+* Function: semTimerUnlink
+* Parameters: ShadowProcess *proc
+* Returns: void
+* Description: Takes proc out of its timer bucket. Interrupts must be off.
+***************/
+static void semTimerUnlink(ShadowProcess *proc) {
+    if(proc->prevTimer != NULL) {
+        proc->prevTimer->nextTimer = proc->nextTimer;
+    }
+    else {
+        semTimers[proc->timerBucket] = proc->nextTimer;
+    }
+    if(proc->nextTimer != NULL) {
+        proc->nextTimer->prevTimer = proc->prevTimer;
+    }
+    proc->nextTimer = NULL;
+    proc->prevTimer = NULL;
+    proc->onTimerList = 0;
+}
+
+static void semTimerCancel(ShadowProcess *proc) {
+    int psr = disableInterrupts();
+    if(proc->onTimerList) {
+        semTimerUnlink(proc);
+    }
+    restoreInterrupts(psr);
+}
+
+/**************
+* Function: semTimerExpire
+* Parameters: int now
+* Returns: void
+* Description: Called from the clock interrupt. Posts a wakeup to every timed waiter whose deadline has passed. If
+*              the wakeup mailbox is already full, SemV or SemFree woke the process first and the timeout is moot.
+***************/
+static void semTimerExpire(int now) {
+    int nowTick = now / SEM_TIMER_TICK_US;
+    int first = semTimerTick;
+    if(nowTick - first >= SEM_TIMER_BUCKETS) {
+        first = nowTick - SEM_TIMER_BUCKETS + 1;  // one turn visits every bucket
+    }
+
+    // The current tick's bucket is visited again next time, for deadlines later in the tick
+    semTimerTick = nowTick;
+    for(int tick = first; tick <= nowTick; tick++) {
+        ShadowProcess *proc = semTimers[tick % SEM_TIMER_BUCKETS];
+        while(proc != NULL) {
+            if(proc->deadline > now) {
+                proc = proc->nextTimer;
+                continue;
+            }
+            semTimerUnlink(proc);
+            if(MboxCondSend(proc->wakeBox, NULL, 0) == 0) {
+                proc->timedOut = 1;
+            }
+            // the wakeup may have let other processes change the bucket, so start it over
+            proc = semTimers[tick % SEM_TIMER_BUCKETS];
+        }
+    }
+}
+
+static int disableInterrupts(void) {
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+    return psr;
+}
+
+static void restoreInterrupts(int psr) {
+    USLOSS_PsrSet(psr);
+}
+
+/**************
+* Function: recordAcquire
+* Parameters: ContentionStats *stats, int contended, int waited
+* Returns: void
+* Description: Counts one acquire of a semaphore or lock, and its wait time if the caller had to block.
+***************/
+static void recordAcquire(ContentionStats *stats, int contended, int waited) {
+    stats->acquisitions++;
+    if(contended) {
+        stats->contended++;
+        stats->totalWait += waited;
+        if(waited > stats->maxWait) {
+            stats->maxWait = waited;
+        }
+    }
+}
+
+/**************
+* Function: recordTopWaiter
+* Parameters: SemStats *stats, int pid, int waited
+* Returns: void
+* Description: Keeps the SEMSTATS_TOP_WAITERS longest single waits on a semaphore, longest first.
+***************/
+static void recordTopWaiter(SemStats *stats, int pid, int waited) {
+    int i = SEMSTATS_TOP_WAITERS - 1;
+    if(stats->topWaiterPid[i] != 0 && stats->topWaiterTime[i] >= waited) {
+        return;
+    }
+    while(i > 0 && (stats->topWaiterPid[i-1] == 0 || stats->topWaiterTime[i-1] < waited)) {
+        stats->topWaiterPid[i] = stats->topWaiterPid[i-1];
+        stats->topWaiterTime[i] = stats->topWaiterTime[i-1];
+        i--;
+    }
+    stats->topWaiterPid[i] = pid;
+    stats->topWaiterTime[i] = waited;
+}
+
+/**************
+* Function: kernelInfoRefresh
+* Parameters: void
+* Returns: void
+* Description: Updates the kernel info page for the current process. Must be called in kernel mode, right before
+*              returning to user mode.
+***************/
+void kernelInfoRefresh(void) {
+    kernelInfoData.pid = getpid();
+}
+
+/**************
+* Function: kernelInfoIntHandler
+* Parameters: int dev, void *arg
+* Returns: void
+* Description: Wraps the phase2 interrupt and syscall handlers. The handler may switch to other processes, but it
+*              always returns to the process it interrupted, so that pid is written back to the info page.
+***************/
+static void kernelInfoIntHandler(int dev, void *arg) {
+    int pid = getpid();
+    if(dev == USLOSS_CLOCK_INT) {
+        kernelInfoData.clockTicks++;
+        semTimerExpire(currentTime());
+    }
+
+    phase2IntVec[dev](dev, arg);
+
+    kernelInfoData.pid = pid;
+}
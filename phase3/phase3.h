@@ -5,9 +5,15 @@
 #ifndef _PHASE3_H
 #define _PHASE3_H
 
+// size of the semaphore table; build with -DMAXSEMS=n to change it
+#ifndef MAXSEMS
 #define MAXSEMS         200
+#endif
 
 extern void phase3_init(void);
 
+// prints the topN semaphores with the most wait time
+extern void dumpSemaphores(int topN);
+
 #endif /* _PHASE3_H */
 
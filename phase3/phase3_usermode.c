@@ -98,13 +98,8 @@ void GetPID(int *pid)
 {
     require_user_mode(__func__);
 
-    USLOSS_Sysargs args;
-    memset(&args, 0, sizeof(args));
-
-    args.number = SYS_GETPID;
-    USLOSS_Syscall(&args);
-
-    *pid = (int)(long)args.arg1;
+    // read from the kernel info page, no syscall needed
+    *pid = kernelInfo->pid;
 }
 
 
@@ -142,6 +137,30 @@ int SemP(int semaphore)
 
 
 
+int SemTimedP(int semaphore, int msecs)
+{
+    require_user_mode(__func__);
+
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_SEMTIMEDP;
+    args.arg1 = (void*)(long)semaphore;
+    args.arg2 = (void*)(long)msecs;
+    USLOSS_Syscall(&args);
+
+    return (int)(long)args.arg4;
+}
+
+
+
+int SemTryP(int semaphore)
+{
+    return SemTimedP(semaphore, 0);
+}
+
+
+
 int SemV(int semaphore)
 {
     require_user_mode(__func__);
@@ -172,3 +191,20 @@ int SemFree(int semaphore)
     return (int)(long)args.arg4;
 }
 
+
+
+int GetSemStats(SemStats *stats, int maxCount, int *count)
+{
+    require_user_mode(__func__);
+
+    USLOSS_Sysargs args;
+    memset(&args, 0, sizeof(args));
+
+    args.number = SYS_SEMSTATS;
+    args.arg1 = stats;
+    args.arg2 = (void*)(long)maxCount;
+    USLOSS_Syscall(&args);
+
+    *count = (int)(long)args.arg2;
+    return   (int)(long)args.arg4;
+}
@@ -5,6 +5,35 @@
 #ifndef _PHASE3_USERMODE_H
 #define _PHASE3_USERMODE_H
 
+// Kernel info page. The kernel refreshes it every time it returns to user
+// mode, so GetPID() can read it without a syscall. GetTimeofDay() still
+// traps: user code can read the time many times between two kernel entries.
+typedef struct KernelInfo {
+    int pid;         // pid of the process running in user mode
+    int clockTicks;  // number of clock interrupts since boot
+} KernelInfo;
+
+extern const volatile KernelInfo *kernelInfo;
+
+// Contention counters, kept for every semaphore and for the lock that
+// guards it. Wait times are in microseconds.
+typedef struct ContentionStats {
+    int acquisitions;  // successful acquires
+    int contended;     // acquires that had to block
+    int totalWait;
+    int maxWait;
+} ContentionStats;
+
+#define SEMSTATS_TOP_WAITERS 3
+
+typedef struct SemStats {
+    int semaphore;
+    ContentionStats sem;
+    ContentionStats lock;
+    int topWaiterPid[SEMSTATS_TOP_WAITERS];   // longest single waits, longest first
+    int topWaiterTime[SEMSTATS_TOP_WAITERS];
+} SemStats;
+
 // Phase 3 -- User Function Prototypes
 extern int  Spawn(char *name, int (*func)(void*), void *arg, int stack_size,
                   int priority, int *pid);
@@ -14,8 +43,10 @@ extern void GetTimeofDay(int *tod);
 extern void GetPID(int *pid);
 extern int  SemCreate(int value, int *semaphore);
 extern int  SemP(int semaphore);
+extern int  SemTryP(int semaphore);
+extern int  SemTimedP(int semaphore, int msecs);
 extern int  SemV(int semaphore);
-
-   // NOTE: No SemFree() call, it was removed
+extern int  SemFree(int semaphore);
+extern int  GetSemStats(SemStats *stats, int maxCount, int *count);
 
 #endif
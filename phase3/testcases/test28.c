@@ -0,0 +1,57 @@
+/*
+ * SemFree test: blocked waiters are woken with an error, and freed slots
+ * are reused so semaphores can be churned well past MAXSEMS.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+int semaphore;
+
+int Child(void *arg)
+{
+    int result;
+
+    USLOSS_Console("%s(): calling SemP on semaphore %d\n", (char*)arg, semaphore);
+    result = SemP(semaphore);
+    USLOSS_Console("%s(): SemP returned %d\n", (char*)arg, result);
+
+    Terminate(0);
+}
+
+int start3(void *arg)
+{
+    int pid, status, result, sem, i;
+
+    USLOSS_Console("start3(): started\n");
+
+    SemCreate(0, &semaphore);
+    Spawn("Child1", Child, "Child1", USLOSS_MIN_STACK, 2, &pid);
+    Spawn("Child2", Child, "Child2", USLOSS_MIN_STACK, 2, &pid);
+
+    result = SemFree(semaphore);
+    USLOSS_Console("start3(): SemFree with two waiters returned %d\n", result);
+
+    Wait(&pid, &status);
+    Wait(&pid, &status);
+
+    result = SemFree(semaphore);
+    USLOSS_Console("start3(): second SemFree returned %d\n", result);
+    result = SemV(semaphore);
+    USLOSS_Console("start3(): SemV on a freed semaphore returned %d\n", result);
+
+    for (i = 0; i < 5 * MAXSEMS; i++) {
+        if (SemCreate(1, &sem) != 0 || SemP(sem) != 0 || SemFree(sem) != 0) {
+            USLOSS_Console("start3(): churn failed at i = %d\n", i);
+            break;
+        }
+    }
+    USLOSS_Console("start3(): created and freed %d semaphores, last one was %d\n", i, sem);
+
+    Terminate(0);
+}
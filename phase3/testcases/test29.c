@@ -0,0 +1,59 @@
+/*
+ * SemTryP and SemTimedP test: a try on an empty semaphore fails at once,
+ * a timed P gives up after its timeout without eating a unit, and a timed P
+ * that is V'ed in time succeeds.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+int semaphore;
+
+int Child(void *arg)
+{
+    int result;
+
+    USLOSS_Console("Child(): calling SemTimedP with a 1000ms timeout\n");
+    result = SemTimedP(semaphore, 1000);
+    USLOSS_Console("Child(): SemTimedP returned %d\n", result);
+
+    Terminate(0);
+}
+
+int start3(void *arg)
+{
+    int pid, status, result, start, end;
+
+    USLOSS_Console("start3(): started\n");
+
+    SemCreate(0, &semaphore);
+    result = SemTryP(semaphore);
+    USLOSS_Console("start3(): SemTryP on an empty semaphore returned %d\n", result);
+
+    GetTimeofDay(&start);
+    result = SemTimedP(semaphore, 100);
+    GetTimeofDay(&end);
+    USLOSS_Console("start3(): SemTimedP(100) on an empty semaphore returned %d\n", result);
+    USLOSS_Console("start3(): waited at least 100ms: %s\n", end - start >= 100000 ? "yes" : "no");
+
+    SemV(semaphore);
+    result = SemTryP(semaphore);
+    USLOSS_Console("start3(): SemTryP after SemV returned %d\n", result);
+
+    Spawn("Child", Child, NULL, USLOSS_MIN_STACK, 2, &pid);
+    USLOSS_Console("start3(): calling SemV\n");
+    SemV(semaphore);
+    Wait(&pid, &status);
+
+    result = SemTryP(semaphore);
+    USLOSS_Console("start3(): SemTryP after the child's P returned %d\n", result);
+    result = SemTimedP(-1, 10);
+    USLOSS_Console("start3(): SemTimedP on an invalid semaphore returned %d\n", result);
+
+    Terminate(0);
+}
@@ -0,0 +1,52 @@
+/*
+ * SemTimedP timer test: three waiters with timeouts shorter than, longer
+ * than, and more than twice one turn of the timer wheel all time out, in
+ * order of their deadlines and no earlier than asked. A timeout too long for
+ * the clock to count to is an error.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+#include <limits.h>
+
+int semaphore;
+
+int Child(void *arg)
+{
+    int timeout = (int)(long)arg;
+    int result, start, end;
+
+    GetTimeofDay(&start);
+    result = SemTimedP(semaphore, timeout);
+    GetTimeofDay(&end);
+    USLOSS_Console("Child(): SemTimedP(%d) returned %d, waited at least %dms: %s\n",
+                   timeout, result, timeout, end - start >= timeout * 1000 ? "yes" : "no");
+
+    Terminate(0);
+}
+
+int start3(void *arg)
+{
+    int pid, status;
+
+    USLOSS_Console("start3(): started\n");
+
+    SemCreate(0, &semaphore);
+    Spawn("Child1500", Child, (void *)1500L, USLOSS_MIN_STACK, 2, &pid);
+    Spawn("Child300", Child, (void *)300L, USLOSS_MIN_STACK, 2, &pid);
+    Spawn("Child2800", Child, (void *)2800L, USLOSS_MIN_STACK, 2, &pid);
+
+    Wait(&pid, &status);
+    Wait(&pid, &status);
+    Wait(&pid, &status);
+
+    USLOSS_Console("start3(): all three timed out\n");
+
+    USLOSS_Console("start3(): SemTimedP(INT_MAX) returned %d\n", SemTimedP(semaphore, INT_MAX));
+    Terminate(0);
+}
@@ -0,0 +1,95 @@
+/*
+ * Semaphore contention stats: three children block on one semaphore in turn
+ * and start3 lets them through one at a time, so the one that blocked last
+ * waits longest. Another semaphore is only ever P'ed when it has a unit.
+ * GetSemStats should put the contended semaphore first, count its acquires
+ * and contended acquires, and list its waiters longest wait first.
+ * Wait times vary from run to run, so the hot semaphore is freed before
+ * dumpSemaphores prints the table, which then has only the cold one. User
+ * mode can't call dumpSemaphores, so the test installs it as the kernel
+ * handler of a later phase's syscall.
+ */
+
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <stdio.h>
+
+int hot, cold;
+int childPid[3];
+
+void dumpSemaphoresSys(USLOSS_Sysargs *args)
+{
+    dumpSemaphores((int)(long)args->arg1);
+}
+
+int Child(void *arg)
+{
+    int id = (int)(long)arg;
+
+    SemP(hot);
+    USLOSS_Console("Child%d(): got through\n", id);
+    Terminate(id);
+}
+
+static void spin(int us)
+{
+    int start, now;
+
+    GetTimeofDay(&start);
+    do {
+        GetTimeofDay(&now);
+    } while (now - start < us);
+}
+
+int start3(void *arg)
+{
+    SemStats stats[4];
+    USLOSS_Sysargs args;
+    int pid, status, count, i;
+
+    USLOSS_Console("start3(): started\n");
+
+    SemCreate(0, &hot);
+    SemCreate(2, &cold);
+    SemP(cold);
+    SemP(cold);
+
+    // each child runs until it blocks
+    for (i = 0; i < 3; i++) {
+        Spawn("Child", Child, (void *)(long)i, USLOSS_MIN_STACK, 2, &childPid[i]);
+    }
+    for (i = 0; i < 3; i++) {
+        spin(20000);
+        SemV(hot);
+    }
+    for (i = 0; i < 3; i++) {
+        Wait(&pid, &status);
+    }
+
+    GetSemStats(stats, 4, &count);
+    USLOSS_Console("start3(): GetSemStats found %d semaphores\n", count);
+    for (i = 0; i < count; i++) {
+        USLOSS_Console("start3(): %s semaphore: %d acquisitions, %d contended\n",
+                       stats[i].semaphore == hot ? "hot" : "cold",
+                       stats[i].sem.acquisitions, stats[i].sem.contended);
+    }
+    for (i = 0; i < SEMSTATS_TOP_WAITERS; i++) {
+        int child = 0;
+        while (child < 3 && childPid[child] != stats[0].topWaiterPid[i]) {
+            child++;
+        }
+        USLOSS_Console("start3(): waiter %d is Child%d\n", i, child);
+    }
+
+    SemFree(hot);
+    systemCallVec[SYS_SEMNAME] = dumpSemaphoresSys;
+    args.number = SYS_SEMNAME;
+    args.arg1 = (void *)2L;
+    USLOSS_Syscall(&args);
+
+    Terminate(0);
+}
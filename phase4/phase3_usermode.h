@@ -15,7 +15,6 @@ extern void GetPID(int *pid);
 extern int  SemCreate(int value, int *semaphore);
 extern int  SemP(int semaphore);
 extern int  SemV(int semaphore);
-
-   // NOTE: No SemFree() call, it was removed
+extern int  SemFree(int semaphore);
 
 #endif
@@ -13,67 +13,306 @@
 */
 
 // Structs
-typedef struct SleepingProc {
+typedef struct Timer Timer;
+
+typedef struct TimerWheel TimerWheel;
+
+// A kernel timer. Armed on a wheel with timerAdd, it calls fire once the
+// wheel's clock reaches expires, unless timerCancel gets to it first
+struct Timer {
+    int expires;                 // wheel->now at which it fires
+    void (*fire)(Timer *timer);  // called with interrupts on, see TimerWheel
+    int arg;                     // for fire, e.g. the pid to wake
+    int armed;
+    int seq;                     // order of arming, so ties fire first come first
+    TimerWheel *wheel;           // wheel it is armed on
+    Timer **bucket;              // slot it is on
+    Timer *prev;
+    Timer *next;
+};
+
+// Hierarchical timing wheel. Level 0 has a slot per tick for the next
+// TIMER_WHEEL_SLOTS ticks, and each level above has a slot per whole turn of
+// the one below. A timer goes on the lowest level that reaches its expiry and
+// moves down a level each time the level below comes round to it, so adding,
+// cancelling and every tick cost the same however many timers are armed
+#define TIMER_WHEEL_BITS   6
+#define TIMER_WHEEL_SLOTS  (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SPAN   (1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+// There are two wheels. sleepWheel turns once per clock tick phase 2 passes
+// to waitDevice, about every 100ms, and fires its timers from ClockDriver.
+// clockWheel turns on every clock interrupt (USLOSS_CLOCK_MS) and fires its
+// timers from the interrupt handler, so their fire must not block. Both are
+// shared with the interrupt handler, so interrupts are off while one changes
+struct TimerWheel {
+    Timer *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    int now;          // ticks so far
+};
+
+// A process's sleep timer. timer must stay first: fire casts it back
+typedef struct Sleeper {
+    Timer timer;
+    int deadline;     // currentTime() SleepUntil waits for
+} Sleeper;
+
+#define CLOCK_TICK_US (USLOSS_CLOCK_MS * 1000)
+
+// Bytes queued by TermWrite for one terminal unit
+typedef struct TermXmit {
+    char data[TERM_XMIT_RING_SIZE];
+    int head;         // next byte to send
+    int count;        // bytes queued, including head
+    int sent;         // bytes handed to the device so far
+    int waiting;      // a writer is blocked on TermXmitSpace for room
+    int kick;         // an interrupt came while the ring was locked
+    int drainWaiters; // processes blocked on TermXmitDrained
+} TermXmit;
+
+// Lines received on one terminal unit. Only the driver moves tail and
+// lineTail, and only a reader holding TermReadLocks moves head and lineHead,
+// so the driver never waits for a reader. Positions only ever grow
+typedef struct TermRecv {
+    char data[TERM_RECV_RING_BYTES];
+    int lineLength[TERM_RECV_RING_LINES];
+    int head;         // bytes taken by readers
+    int tail;         // bytes queued by the driver
+    int lineHead;
+    int lineTail;
+} TermRecv;
+
+// How far each terminal's output has to get before a process may exit, kept
+// by pid % MAXPROC
+typedef struct TermWriter {
     int pid;
-    int wakeupTime;
-    struct SleepingProc *next;
-} SleepingProc;
+    int until[USLOSS_TERM_UNITS];  // TermXmit.sent after its last byte, 0 if none
+} TermWriter;
 
 typedef struct DiskRequest DiskRequest;
 
+// One contiguous run of sectors of a scatter-gather request
+typedef struct DiskSegment {
+    int sector;       // track * USLOSS_DISK_TRACK_SIZE + block
+    int blocks;
+    char *buffer;
+} DiskSegment;
+
+// A command handed to a queued disk, found again by the tag its interrupt carries
+typedef struct DiskSlot {
+    DiskRequest *req;   // NULL if the slot is free
+    int track;
+} DiskSlot;
+
+// Operation of a DiskSync request, which waits on the side instead of in the queue
+#define DISK_BARRIER -1
+
 struct DiskRequest {
-    int operation;
+    int operation;    // USLOSS_DISK_READ, USLOSS_DISK_WRITE, USLOSS_DISK_TRACKS or DISK_BARRIER
     int track;
+    int firstBlock;
+    int blocks;
+    char *buffer;
+    DiskSegment *segments;  // if not NULL, the request is these runs instead, sorted by sector
+    int segmentCount;
+    int pid;          // caller, woken through its DiskWaitBoxes entry when done
+    int status;       // device status of the whole request, set by the driver
+    void (*done)(int unit, DiskRequest *req);  // called by the driver instead of waking pid
+    int seq;          // order of arrival on the unit
+    int queued;       // currentTime() it was queued at, for diskStats
+    int ioClass;      // DISK_CLASS_*, raised as the request ages; DEFAULT until first scheduled
+    int age;          // requests served ahead of it since it was last raised
     DiskRequest *next;
 };
 
+// A request started by SYS_DISKASYNC. req must stay first: the driver's
+// completion callback casts it back to its ticket.
+typedef struct AsyncTicket {
+    DiskRequest req;
+    int inUse;
+    int waited;       // someone is already in DiskWait for it
+    int done;         // completed, and the status is waiting in doneBox
+    int orphaned;     // its process quit, so nobody will wait for it
+    int ticket;
+    int mbox;
+    int doneBox;      // gets a message when the request completes
+} AsyncTicket;
+
 typedef struct Disk {
     USLOSS_DeviceRequest request;
     int unit;
     int tracks;
     int track_size;
-    int current_track;
+    int current_track;          // where the head is, or -1 if unknown
+    int combinedWrites;         // writes done in another write's pass over the track
+    int skippedSectors;         // sectors those writes had in common, written only once
+    char run[USLOSS_DISK_TRACK_SIZE * USLOSS_DISK_SECTOR_SIZE];  // sectors diskRun moves
     int sector_size;
     int disk_size;
     int status;
-    DiskRequest *requestQueue;
+    int nextSeq;
+    DiskRequest *requestQueue;  // pending requests, sorted by track
+    DiskRequest *barriers;      // DiskSync callers waiting for the requests ahead of them
 } Disk;
 
+// One sector held by the disk block cache
+typedef struct CacheBlock {
+    int unit;
+    int sector;       // track * USLOSS_DISK_TRACK_SIZE + block
+    int valid;
+    int dirty;
+    char data[USLOSS_DISK_SECTOR_SIZE];
+    struct CacheBlock *prev;      // LRU list, most recently used first
+    struct CacheBlock *next;
+    struct CacheBlock *hashNext;
+} CacheBlock;
+
+#define DISK_CACHE_HASH_SIZE (2 * DISK_CACHE_BLOCKS)
+
+// Sequential read-ahead, tracked per process and unit. The window doubles on
+// every sequential read, up to the rest of the track plus the next track, and
+// halves on every read that doesn't pick up where the last one ended.
+#define READAHEAD_MIN_WINDOW 4
+#define READAHEAD_MAX_WINDOW (2 * USLOSS_DISK_TRACK_SIZE)
+
+// Disk I/O class of a process, kept by pid % MAXPROC
+typedef struct IoClass {
+    int pid;
+    int priorityClass;  // from the priority Spawn gave it
+    int ioClass;        // set by DiskSetClass, or DISK_CLASS_DEFAULT
+} IoClass;
+
+typedef struct ReadAhead {
+    int pid;
+    int nextSector;   // sector right after the last read
+    int window;       // sectors to prefetch, 0 until reads look sequential
+} ReadAhead;
+
 // Prototypes
 int TerminalDriver(char *arg);
 void sleepSysHandler(USLOSS_Sysargs *args);
 int Kernel_Sleep(int time);
+int Kernel_SleepUntil(int deadline);
+void sleepWake(Timer *timer);
+void sleepUntilWake(Timer *timer);
+void clockWheelHandler(int dev, void *arg);
+void timerAdd(TimerWheel *wheel, Timer *timer, int ticks);
+int timerCancel(Timer *timer);
+void timerInsert(TimerWheel *wheel, Timer *timer);
+void timerUnlink(Timer *timer);
+Timer *timerExpire(TimerWheel *wheel);
+void timerFire(Timer *expired);
+int interruptsOff(void);
+void interruptsRestore(int psr);
 void termReadSysHandler(USLOSS_Sysargs *args);
 void termWriteSysHandler(USLOSS_Sysargs *args);
-int Kernel_TermRead(char *buffer, int bufferSize, int unit, int *charsRead);
+int Kernel_TermRead(char *buffer, int bufferSize, int unit, int flags, int *charsRead);
+void termRecvLine(int unit, char *line, int length);
 int Kernel_TermWrite(char *buff, int buffSize, int unit, int *charWrite);
+void termXmitNext(int unit);
+void termXmitUnlock(int unit);
+void Kernel_TermDrain(int pid);
+void terminateSysHandler(USLOSS_Sysargs *args);
 void diskReadSysHandler(USLOSS_Sysargs *args);
+void diskAsyncSysHandler(USLOSS_Sysargs *args);
+int Kernel_DiskAsync(int operation, DiskAsyncRequest *request, int *ticket);
+int Kernel_DiskWait(int ticket, int *status);
+int Kernel_DiskSetClass(int ioClass);
+int diskIoClass(int pid);
+void spawnSysHandler(USLOSS_Sysargs *args);
+void diskAsyncDone(int unit, DiskRequest *req);
+void diskAsyncReclaim(int pid);
+void diskIoVSysHandler(USLOSS_Sysargs *args);
+int Kernel_DiskIoV(int operation, int unit, DiskIoVec *iov, int count, int *status);
 void diskWriteSysHandler(USLOSS_Sysargs *args);
 void diskSizeSysHandler(USLOSS_Sysargs *args);
+void diskSyncSysHandler(USLOSS_Sysargs *args);
+int Kernel_DiskSync(int unit);
+void deviceStatsSysHandler(USLOSS_Sysargs *args);
+int Kernel_DeviceStats(int type, int unit, void *stats);
 int Kernel_DiskRead(void *buffer, int unit, int track, int firstBlock, int blocks, int *status);
 int Kernel_DiskWrite(void *buffer, int unit, int track, int firstBlock, int blocks, int *status);
 int Kernel_DiskSize(int unit, int *sector, int *track, int *disk);
 int DiskDriver(char *arg);
+void diskSubmit(int unit, DiskRequest *req);
+void diskEnqueue(int unit, DiskRequest *req);
+void diskAccount(int unit, DiskRequest *req, int start, int end);
+void diskReadAhead(int unit, int firstSector, int blocks);
+void diskReadAheadDone(int unit, DiskRequest *req);
+DiskRequest *diskNextRequest(Disk *disk);
+DiskRequest *diskReleaseBarriers(Disk *disk);
+DiskRequest *diskCombineWrites(Disk *disk, DiskRequest *req);
+int diskService(int unit, DiskRequest *req);
+int diskServiceCombined(int unit, DiskRequest *req);
+void diskServiceQueued(int unit, DiskRequest *batch);
+int diskQueueCommand(int unit, DiskSlot *slots, DiskRequest *req, USLOSS_DiskCommand *command);
+void diskQueueWait(int unit, DiskSlot *slots);
+int diskOp(int unit, int operation, void *reg1, void *reg2);
+int diskRun(int unit, int operation, int block, int count);
+int diskSeek(int unit, int track);
+int diskTracks(int unit);
+int diskTransfer(int operation, int unit, int track, int firstBlock, int blocks, char *buffer);
+int DiskFlusher(char *arg);
+CacheBlock *cacheLookup(int unit, int sector);
+CacheBlock *cacheInsert(int unit, int sector);
+void cacheStore(int unit, int first, int blocks, char *buff, int dirty);
+void cacheStoreWritten(int unit, DiskRequest *req);
+int cacheFill(int unit, int first, int blocks, char *data);
+void cacheTouch(CacheBlock *block);
+void cacheWriteBack(CacheBlock *block);
+void cacheFlush(void);
+void cacheFlushUnit(int unit);
 int ClockDriver(char *arg);
 
 void lock(int lockId);
 void unlock(int lockId);
 
 // Global variables
-int clockTicks = 0;
-int sleepLock;
 
 // Tables and Queues
-int TermReadBoxes[USLOSS_TERM_UNITS];
+TermRecv termRecv[USLOSS_TERM_UNITS];
+TermStats termStats[USLOSS_TERM_UNITS];
+int TermReadLocks[USLOSS_TERM_UNITS];
+int TermRecvReady[USLOSS_TERM_UNITS];
 int TermWriteLocks[USLOSS_TERM_UNITS];
-int TermWriteBoxes[USLOSS_TERM_UNITS];
-
-SleepingProc sleeping[MAXPROC];
-SleepingProc *sleepingQueue = NULL;
+TermXmit termXmit[USLOSS_TERM_UNITS];
+int TermXmitLocks[USLOSS_TERM_UNITS];
+int TermXmitSpace[USLOSS_TERM_UNITS];
+int TermXmitDrained[USLOSS_TERM_UNITS];
+TermWriter termWriters[MAXPROC];
+void (*phase3TerminateHandler)(USLOSS_Sysargs *args);
+
+TimerWheel sleepWheel;
+TimerWheel clockWheel;
+int timerSeq = 0;
+Sleeper sleepers[MAXPROC];
+int SleepBoxes[MAXPROC];
+void (*phase2ClockHandler)(int dev, void *arg);
 
 Disk disks[USLOSS_DISK_UNITS];
 int diskLocks[USLOSS_DISK_UNITS];
 int DiskRequestBoxes[USLOSS_DISK_UNITS];
+int DiskWaitBoxes[MAXPROC];
+
+CacheBlock cacheBlocks[DISK_CACHE_BLOCKS];
+CacheBlock *cacheHash[DISK_CACHE_HASH_SIZE];
+CacheBlock *cacheMRU = NULL;
+CacheBlock *cacheLRU = NULL;
+int cacheLock;
+DiskCacheStats diskCacheStats;
+DiskStats diskStats[USLOSS_DISK_UNITS];
+
+ReadAhead readAhead[MAXPROC][USLOSS_DISK_UNITS];
+DiskRequest readAheadReq[USLOSS_DISK_UNITS];  // at most one prefetch in flight per unit
+int readAheadBusy[USLOSS_DISK_UNITS];
+char readAheadData[USLOSS_DISK_UNITS][READAHEAD_MAX_WINDOW * USLOSS_DISK_SECTOR_SIZE];
+
+AsyncTicket asyncTickets[DISK_ASYNC_TICKETS];
+int asyncLock;
+int asyncSeq = 0;
+
+IoClass ioClasses[MAXPROC];
+void (*phase3SpawnHandler)(USLOSS_Sysargs *args);
 
 
 /* 
@@ -87,15 +326,37 @@ void phase4_init(void) {
     systemCallVec[SYS_DISKSIZE] = diskSizeSysHandler;
     systemCallVec[SYS_DISKREAD] = diskReadSysHandler;
     systemCallVec[SYS_DISKWRITE] = diskWriteSysHandler;
+    systemCallVec[SYS_DISKASYNC] = diskAsyncSysHandler;
+    systemCallVec[SYS_DISKIOV] = diskIoVSysHandler;
+    systemCallVec[SYS_DISKSYNC] = diskSyncSysHandler;
+    systemCallVec[SYS_DEVICESTATS] = deviceStatsSysHandler;
+
+    // Spawn is phase 3's; wrap it to learn the priority of each new process
+    phase3SpawnHandler = systemCallVec[SYS_SPAWN];
+    systemCallVec[SYS_SPAWN] = spawnSysHandler;
 
-    memset(sleeping, 0, sizeof(sleeping));
+    // and Terminate, so a process's queued terminal output goes out and its
+    // disk tickets are freed before it exits
+    phase3TerminateHandler = systemCallVec[SYS_TERMINATE];
+    systemCallVec[SYS_TERMINATE] = terminateSysHandler;
 
-    // Create mailboxes for each terminal unit to store read buffers (up to 10)
+    memset(&sleepWheel, 0, sizeof(sleepWheel));
+    memset(&clockWheel, 0, sizeof(clockWheel));
+    memset(sleepers, 0, sizeof(sleepers));
+
+    // Create the locks and wakeup mailboxes of each terminal unit's rings
     for (int i = 0; i < USLOSS_TERM_UNITS; i++) {
-        TermReadBoxes[i] = MboxCreate(10, MAXLINE);  // create returns maibox id
-        TermWriteBoxes[i] = MboxCreate(0, 0);
+        TermReadLocks[i] = MboxCreate(1, 0);
+        TermRecvReady[i] = MboxCreate(1, 0);
         TermWriteLocks[i] = MboxCreate(1, 0);
+        TermXmitLocks[i] = MboxCreate(1, 0);
+        TermXmitSpace[i] = MboxCreate(1, 0);
+        TermXmitDrained[i] = MboxCreate(MAXPROC, 0);
     }
+    memset(termRecv, 0, sizeof(termRecv));
+    memset(termStats, 0, sizeof(termStats));
+    memset(termXmit, 0, sizeof(termXmit));
+    memset(termWriters, 0, sizeof(termWriters));
 
     // Initialize the two disk structs and their mailboxes
     for (int i = 0; i < USLOSS_DISK_UNITS; i++) {
@@ -109,12 +370,50 @@ void phase4_init(void) {
         disks[i].request.reg1 = (void *)(long)-1;
         disks[i].request.reg2 = (void *)(long)-1;
         disks[i].current_track = -1;
+        disks[i].combinedWrites = 0;
+        disks[i].skippedSectors = 0;
+        disks[i].nextSeq = 0;
+        disks[i].requestQueue = NULL;
+        disks[i].barriers = NULL;
         diskLocks[i] = MboxCreate(1, 0);
         DiskRequestBoxes[i] = MboxCreate(1, 0);
     }
 
-    // Create lock for sleep handler
-    sleepLock = MboxCreate(1, 0);
+    // Each process waits for its own disk requests in its own mailbox
+    for (int i = 0; i < MAXPROC; i++) {
+        DiskWaitBoxes[i] = MboxCreate(1, 0);
+    }
+
+    // Every cache block starts out invalid on the LRU list
+    memset(cacheBlocks, 0, sizeof(cacheBlocks));
+    memset(cacheHash, 0, sizeof(cacheHash));
+    memset(&diskCacheStats, 0, sizeof(diskCacheStats));
+    memset(diskStats, 0, sizeof(diskStats));
+    memset(readAhead, 0, sizeof(readAhead));
+    memset(readAheadBusy, 0, sizeof(readAheadBusy));
+    for (int i = 0; i < DISK_CACHE_BLOCKS; i++) {
+        cacheBlocks[i].prev = (i > 0) ? &cacheBlocks[i - 1] : NULL;
+        cacheBlocks[i].next = (i < DISK_CACHE_BLOCKS - 1) ? &cacheBlocks[i + 1] : NULL;
+    }
+    cacheMRU = &cacheBlocks[0];
+    cacheLRU = &cacheBlocks[DISK_CACHE_BLOCKS - 1];
+    cacheLock = MboxCreate(1, 0);
+
+    memset(ioClasses, 0, sizeof(ioClasses));
+    memset(asyncTickets, 0, sizeof(asyncTickets));
+    for (int i = 0; i < DISK_ASYNC_TICKETS; i++) {
+        asyncTickets[i].doneBox = MboxCreate(1, 0);
+    }
+    asyncLock = MboxCreate(1, 0);
+
+    // Create a mailbox for each process to sleep on
+    for (int i = 0; i < MAXPROC; i++) {
+        SleepBoxes[i] = MboxCreate(1, 0);
+    }
+
+    // Turn clockWheel on every clock interrupt, before phase 2 sees it
+    phase2ClockHandler = USLOSS_IntVec[USLOSS_CLOCK_INT];
+    USLOSS_IntVec[USLOSS_CLOCK_INT] = clockWheelHandler;
 
     // Enable interrupts for terminal units
     int control = 0;
@@ -145,6 +444,11 @@ void phase4_start_service_processes(void) {
     // start disk device drivers for each unit, will act as a waiting process for interrupts
     spork("DiskDriver1", DiskDriver, "0", USLOSS_MIN_STACK, 1);
     spork("DiskDriver2", DiskDriver, "1", USLOSS_MIN_STACK, 1);
+
+    // only write-back caching leaves dirty blocks behind
+    if (DISK_CACHE_WRITEBACK) {
+        spork("DiskFlusher", DiskFlusher, NULL, USLOSS_MIN_STACK, 2);
+    }
 }
 
 /*
@@ -171,18 +475,23 @@ int TerminalDriver(char *arg) {
             buffer[count] = receivedChar;
             count += 1;
 
-            // Send buffer if encounter newline or buffer is full. Reset buffer and count
+            // Queue buffer if encounter newline or buffer is full. Reset buffer and count
             if (receivedChar == '\n' || count == MAXLINE) {
-                MboxCondSend(TermReadBoxes[unit], buffer, count);
+                termRecvLine(unit, buffer, count);
                 strcpy(buffer, "");
                 count = 0;
             }
         }
 
-        // Check if the terminal is ready to write
-        if (USLOSS_TERM_STAT_XMIT(status) == USLOSS_DEV_READY) {
-            // Send a message to the write request mailbox
-            MboxCondSend(TermWriteBoxes[unit], NULL, 0);
+        // Send the next queued byte. This is tried on every interrupt, not only
+        // on xmit ones, so output still moves if one of those was missed. An
+        // interrupt that comes while we aren't in waitDevice is lost, so never
+        // block on the ring: if it's locked, leave it to whoever holds it
+        if (MboxCondSend(TermXmitLocks[unit], NULL, 0) == 0) {
+            termXmitUnlock(unit);
+        }
+        else {
+            termXmit[unit].kick = 1;
         }
     }
     return 0;
@@ -199,17 +508,12 @@ int ClockDriver(char *arg) {
     while (1) {
         waitDevice(USLOSS_CLOCK_DEV, 0, &status);
 
-        lock(sleepLock);
-        clockTicks++;
+        int psr = interruptsOff();
+        sleepWheel.now++;
+        Timer *expired = timerExpire(&sleepWheel);
+        interruptsRestore(psr);
 
-        // Wake up any processes whose sleep time has expired
-        while (sleepingQueue != NULL && sleepingQueue->wakeupTime <= clockTicks) {
-            SleepingProc *toWake = sleepingQueue;
-            unblockProc(toWake->pid);
-            sleepingQueue = sleepingQueue->next;
-        }
-
-        unlock(sleepLock);
+        timerFire(expired);
     }
 
     return 0;
@@ -217,16 +521,29 @@ int ClockDriver(char *arg) {
 
 /*
 * Function: sleepSysHandler
-* Handles the sleep system call
+* Handles the sleep system call. arg2 says what arg1 is: SLEEP_SECONDS,
+* SLEEP_MS or SLEEP_UNTIL
 * @param args: the system arguments
 */
 void sleepSysHandler(USLOSS_Sysargs *args) {
 
     // Extract arguments
-    int sec = (int)(long)args->arg1;
-    
-    // Call Kernel_sleep
-    int sysStat = Kernel_Sleep(sec);
+    int time = (int)(long)args->arg1;
+    int mode = (int)(long)args->arg2;
+
+    int sysStat;
+    if (mode == SLEEP_SECONDS) {
+        sysStat = Kernel_Sleep(time);
+    }
+    else if (mode == SLEEP_MS && time >= 0) {
+        sysStat = Kernel_SleepUntil(currentTime() + time * 1000);
+    }
+    else if (mode == SLEEP_UNTIL) {
+        sysStat = Kernel_SleepUntil(time);
+    }
+    else {
+        sysStat = -1;
+    }
     args->arg4 = (void *)(long)sysStat;
 }
 
@@ -234,79 +551,356 @@ void sleepSysHandler(USLOSS_Sysargs *args) {
 * Function: Kernel_Sleep
 * Puts the current process to sleep for a specified amount of time
 * @param time: the number of seconds to sleep
+* @return 0 on success, -1 on failure
 */
 int Kernel_Sleep(int time) {
-    // make sure we are in kernel mode
-    
-    lock(sleepLock);
     if (time < 0) {
         return -1;
     }
 
-    int waitTime = clockTicks + (time * 10);
-    int status;
     int pid = getpid();
+    Timer *timer = &sleepers[pid % MAXPROC].timer;
+    timer->fire = sleepWake;
+    timer->arg = pid;
+    timerAdd(&sleepWheel, timer, time * 10);
+
+    MboxRecv(SleepBoxes[pid % MAXPROC], NULL, 0);
+    return 0;
+}
+
+/*
+* Function: Kernel_SleepUntil
+* Puts the current process to sleep until the first clock interrupt at or
+* after a given time, so it never wakes early and wakes at most one clock
+* tick late. Returns at once if the time has passed
+* @param deadline: the time to wake, as read by currentTime()
+* @return 0
+*/
+int Kernel_SleepUntil(int deadline) {
+    int wait = deadline - currentTime();
+    if (wait <= 0) {
+        return 0;
+    }
+
+    int pid = getpid();
+    Sleeper *sleeper = &sleepers[pid % MAXPROC];
+    sleeper->deadline = deadline;
+    sleeper->timer.fire = sleepUntilWake;
+    sleeper->timer.arg = pid;
+
+    // Ticks don't come exactly CLOCK_TICK_US apart, and the first is less
+    // than that away, so this can land a tick early; sleepUntilWake checks
+    timerAdd(&clockWheel, &sleeper->timer, (wait + CLOCK_TICK_US - 1) / CLOCK_TICK_US);
+
+    MboxRecv(SleepBoxes[pid % MAXPROC], NULL, 0);
+    return 0;
+}
+
+/*
+* Function: sleepWake
+* Fires a Sleep timer by waking the process that set it
+* @param timer: the timer
+*/
+void sleepWake(Timer *timer) {
+    MboxCondSend(SleepBoxes[timer->arg % MAXPROC], NULL, 0);
+}
+
+/*
+* Function: sleepUntilWake
+* Fires a SleepUntil timer from the clock interrupt. Wakes the process that set
+* it if its deadline has come, otherwise waits one more tick
+* @param timer: the timer
+*/
+void sleepUntilWake(Timer *timer) {
+    Sleeper *sleeper = (Sleeper *)timer;
+    if (currentTime() < sleeper->deadline) {
+        timerAdd(&clockWheel, timer, 1);
+    }
+    else {
+        MboxCondSend(SleepBoxes[timer->arg % MAXPROC], NULL, 0);
+    }
+}
+
+/*
+* Function: clockWheelHandler
+* Wraps phase 2's clock interrupt handler to turn clockWheel and fire its
+* timers first
+* @param dev: the device, USLOSS_CLOCK_DEV
+* @param arg: the unit
+*/
+void clockWheelHandler(int dev, void *arg) {
+    clockWheel.now++;
+    timerFire(timerExpire(&clockWheel));
+    phase2ClockHandler(dev, arg);
+}
+
+/*
+* Function: timerAdd
+* Arms a timer to fire the given number of ticks of a wheel from now. A timer
+* that is already armed is moved. A delay of 0 fires on the next tick
+* @param wheel: sleepWheel or clockWheel
+* @param timer: the timer, with fire and arg set
+* @param ticks: the delay
+*/
+void timerAdd(TimerWheel *wheel, Timer *timer, int ticks) {
+    int psr = interruptsOff();
+    if (timer->armed) {
+        timerUnlink(timer);
+    }
+    timer->wheel = wheel;
+    timer->expires = wheel->now + (ticks > 0 ? ticks : 1);
+    timer->armed = 1;
+    timer->seq = timerSeq++;
+    timerInsert(wheel, timer);
+    interruptsRestore(psr);
+}
+
+/*
+* Function: timerCancel
+* Disarms a timer
+* @param timer: the timer
+* @return 1 if it was still armed, 0 if it had fired or was never armed
+*/
+int timerCancel(Timer *timer) {
+    int psr = interruptsOff();
+    int armed = timer->armed;
+    if (armed) {
+        timerUnlink(timer);
+        timer->armed = 0;
+    }
+    interruptsRestore(psr);
+    return armed;
+}
+
+/*
+* Function: timerInsert
+* Puts an armed timer on the wheel slot for its expiry: on level 0 if that is
+* less than a turn away, otherwise on the lowest level whose turn reaches it.
+* One too far off for the top level goes as far as the top level reaches, and
+* is put back when it gets there. One cascaded down on the tick it is due goes
+* on level 0's current slot, which timerExpire empties next. Interrupts are off
+* @param wheel: the wheel
+* @param timer: the timer
+*/
+void timerInsert(TimerWheel *wheel, Timer *timer) {
+    int when = timer->expires;
+    if (when < wheel->now) {
+        when = wheel->now;
+    }
+    if (when - wheel->now >= TIMER_WHEEL_SPAN) {
+        when = wheel->now + TIMER_WHEEL_SPAN - 1;
+    }
+
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 &&
+           when - wheel->now >= 1 << (TIMER_WHEEL_BITS * (level + 1))) {
+        level++;
+    }
 
-    // create new sleeping process
-    SleepingProc *newSleep = &sleeping[pid % MAXPROC];
-    newSleep->pid = pid;
-    newSleep->wakeupTime = waitTime;
-    newSleep->next = NULL;
+    Timer **bucket = &wheel->slots[level][(when >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+    timer->bucket = bucket;
+    timer->prev = NULL;
+    timer->next = *bucket;
+    if (*bucket != NULL) {
+        (*bucket)->prev = timer;
+    }
+    *bucket = timer;
+}
 
-    // add to the queue
-    if (sleepingQueue == NULL) {
-        sleepingQueue = newSleep;
+/*
+* Function: timerUnlink
+* Takes an armed timer off its wheel slot. Interrupts are off
+* @param timer: the timer
+*/
+void timerUnlink(Timer *timer) {
+    if (timer->prev != NULL) {
+        timer->prev->next = timer->next;
     }
     else {
-        // insert in order
-        SleepingProc *prev = NULL;
-        SleepingProc *current = sleepingQueue;
-        while (current != NULL && current->wakeupTime <= newSleep->wakeupTime) {
-            prev = current;
-            current = current->next;
+        *timer->bucket = timer->next;
+    }
+    if (timer->next != NULL) {
+        timer->next->prev = timer->prev;
+    }
+}
+
+/*
+* Function: timerExpire
+* Advances a wheel to its new now. Each level whose turn has come round moves
+* its current slot down, then the timers on level 0's current slot are
+* disarmed and returned. Interrupts are off
+* @param wheel: the wheel
+* @return the timers due now, linked through next in the order they expire
+*/
+Timer *timerExpire(TimerWheel *wheel) {
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        if ((wheel->now & ((1 << (TIMER_WHEEL_BITS * level)) - 1)) != 0) {
+            break;
         }
-        if (prev == NULL) {
-            newSleep->next = sleepingQueue;
-            sleepingQueue = newSleep;
+        Timer **bucket = &wheel->slots[level][(wheel->now >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+        Timer *timer = *bucket;
+        *bucket = NULL;
+        while (timer != NULL) {
+            Timer *next = timer->next;
+            timerInsert(wheel, timer);
+            timer = next;
+        }
+    }
+
+    Timer **bucket = &wheel->slots[0][wheel->now & (TIMER_WHEEL_SLOTS - 1)];
+    Timer *timer = *bucket;
+    Timer *expired = NULL;
+    *bucket = NULL;
+    while (timer != NULL) {
+        Timer *next = timer->next;
+        if (timer->expires > wheel->now) {
+            timerInsert(wheel, timer);  // was beyond the top level's reach
         }
         else {
-            newSleep->next = prev->next;
-            prev->next = newSleep;
+            // Slots aren't kept in order, and hardly more than one timer is
+            // due at a time, so sort the ones that are as they come off
+            Timer **link = &expired;
+            while (*link != NULL && ((*link)->expires < timer->expires ||
+                   ((*link)->expires == timer->expires && (*link)->seq < timer->seq))) {
+                link = &(*link)->next;
+            }
+            timer->armed = 0;
+            timer->next = *link;
+            *link = timer;
         }
+        timer = next;
     }
+    return expired;
+}
 
-    unlock(sleepLock);
-    blockMe();
-    return 0;
+/*
+* Function: timerFire
+* Calls fire for each timer timerExpire returned. One may be armed again from
+* its own fire
+* @param expired: the timers, linked through next
+*/
+void timerFire(Timer *expired) {
+    while (expired != NULL) {
+        Timer *timer = expired;
+        expired = expired->next;
+        timer->fire(timer);
+    }
+}
+
+/*
+* Function: interruptsOff
+* Turns interrupts off
+* @return the PSR to restore
+*/
+int interruptsOff(void) {
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+    return psr;
+}
+
+/*
+* Function: interruptsRestore
+* Puts interrupts back the way interruptsOff found them
+* @param psr: what interruptsOff returned
+*/
+void interruptsRestore(int psr) {
+    USLOSS_PsrSet(psr);
 }
 
 /*
 * Function: Kernel_TermRead
-* Reads characters from the terminal mailbox
+* Takes the oldest line off the terminal's input ring, waiting for one if
+* there is none. With TERM_READ_LINES it goes on taking whole lines as long as
+* they fit in the buffer with room left for the terminating null; a single
+* line may fill the whole buffer, and is only null terminated if it doesn't
 * @param buff: the buffer to read into
 * @param buffSize: the size of the buffer
 * @param unit: the terminal unit to read from
+* @param flags: 0 or TERM_READ_LINES
 * @param charsRead: the number of characters read
 * @return 0 on success, -1 on failure
 */
-int Kernel_TermRead(char *buff, int buffSize, int unit, int *charsRead) {
-    if (unit < 0 || unit >= USLOSS_TERM_UNITS || buff == NULL || buffSize <= 0) {
+int Kernel_TermRead(char *buff, int buffSize, int unit, int flags, int *charsRead) {
+    int limit = (flags & TERM_READ_LINES) ? buffSize - 1 : buffSize;
+    if (unit < 0 || unit >= USLOSS_TERM_UNITS || buff == NULL || limit <= 0) {
         return -1;
     }
 
-    // Expecting that interrupts are being handled in the terminal driver, just need
-    // to grab the characters from the mailbox
-    char readin[MAXLINE + 1];
-    *charsRead = MboxRecv(TermReadBoxes[unit], readin, MAXLINE);
+    // Readers line up on the lock, so the first one in gets the first line
+    TermRecv *ring = &termRecv[unit];
+    lock(TermReadLocks[unit]);
+    while (ring->lineHead == ring->lineTail) {
+        MboxRecv(TermRecvReady[unit], NULL, 0);
+    }
+
+    *charsRead = 0;
+    do {
+        int length = ring->lineLength[ring->lineHead % TERM_RECV_RING_LINES];
+        if (*charsRead > 0 && *charsRead + length > limit) {
+            break;
+        }
 
-    memcpy(buff, readin, buffSize);  // use buffSize to copy only the number of characters requested
-    if (*charsRead > buffSize) {
-        *charsRead = buffSize;  // only copy the number of characters requested
+        // The first line is cut short if it doesn't fit; the rest of it is lost
+        int copy = (length < limit - *charsRead) ? length : limit - *charsRead;
+        for (int i = 0; i < copy; i++) {
+            buff[*charsRead + i] = ring->data[(ring->head + i) % TERM_RECV_RING_BYTES];
+        }
+        *charsRead += copy;
+        ring->head += length;
+        ring->lineHead++;
+    } while ((flags & TERM_READ_LINES) && ring->lineHead != ring->lineTail);
+    unlock(TermReadLocks[unit]);
+
+    if (*charsRead < buffSize) {
+        buff[*charsRead] = '\0';  // null terminate the string
     }
-    buff[*charsRead] = '\0';  // null terminate the string
     return 0;
 }
 
+/*
+* Function: termRecvLine
+* Queues a line the driver has received on the terminal's input ring and wakes
+* a reader. If the ring is full the line is dropped, unless TERM_RECV_OVERWRITE
+* lets it replace the oldest lines; that needs TermReadLocks, and the driver
+* can't wait for it, so while a reader holds it the new line is dropped anyway
+* @param unit: the terminal unit
+* @param line: the characters received
+* @param length: how many there are, at most MAXLINE
+*/
+void termRecvLine(int unit, char *line, int length) {
+    TermRecv *ring = &termRecv[unit];
+    TermStats *stats = &termStats[unit];
+    stats->received += length;
+
+    int full = ring->lineTail - ring->lineHead == TERM_RECV_RING_LINES ||
+               ring->tail - ring->head + length > TERM_RECV_RING_BYTES;
+    if (full && TERM_RECV_POLICY == TERM_RECV_OVERWRITE &&
+        MboxCondSend(TermReadLocks[unit], NULL, 0) == 0) {
+        while (full) {
+            int oldest = ring->lineLength[ring->lineHead % TERM_RECV_RING_LINES];
+            ring->head += oldest;
+            ring->lineHead++;
+            stats->dropped += oldest;
+            stats->droppedLines++;
+            full = ring->tail - ring->head + length > TERM_RECV_RING_BYTES;
+        }
+        unlock(TermReadLocks[unit]);
+    }
+    if (full) {
+        stats->dropped += length;
+        stats->droppedLines++;
+        return;
+    }
+
+    for (int i = 0; i < length; i++) {
+        ring->data[(ring->tail + i) % TERM_RECV_RING_BYTES] = line[i];
+    }
+    ring->lineLength[ring->lineTail % TERM_RECV_RING_LINES] = length;
+    ring->tail += length;
+    ring->lineTail++;
+    MboxCondSend(TermRecvReady[unit], NULL, 0);
+}
+
 
 /*
 * Function: termReadSysHandler
@@ -318,10 +912,11 @@ void termReadSysHandler(USLOSS_Sysargs *args) {
     char *buff = (char *)args->arg1;
     int buffSize = (int)(long)args->arg2;
     int unit = (int)(long)args->arg3;
+    int flags = (int)(long)args->arg4;
 
-    // Grab the characters from the mailbox
+    // Take the characters off the input ring
     int charRead = 0;
-    int sysStat = Kernel_TermRead(buff, buffSize, unit, &charRead);
+    int sysStat = Kernel_TermRead(buff, buffSize, unit, flags, &charRead);
 
     args->arg2 = (void *)(long)charRead;
     args->arg4 = (void *)(long)sysStat;
@@ -329,7 +924,8 @@ void termReadSysHandler(USLOSS_Sysargs *args) {
 
 /*
 * Function: Kernel_TermWrite
-* Writes characters to the terminal
+* Queues characters on the terminal's transmit ring. Returns once they are all
+* queued, waiting for the driver to make room only if the ring fills up
 * @param buff: the buffer to write from
 * @param buffSize: the size of the buffer
 * @param unit: the terminal unit to write to
@@ -341,23 +937,139 @@ int Kernel_TermWrite(char *buff, int buffSize, int unit, int *charWrite) {
         return -1;
     }
 
-    // Write the characters to the terminal
-    for (int i = 0; i < buffSize; i++) {
-        MboxRecv(TermWriteBoxes[unit], NULL, 0);
+    TermXmit *ring = &termXmit[unit];
+    TermWriter *writer = &termWriters[getpid() % MAXPROC];
+    if (writer->pid != getpid()) {
+        memset(writer, 0, sizeof(*writer));
+        writer->pid = getpid();
+    }
+
+    while (*charWrite < buffSize) {
+        lock(TermXmitLocks[unit]);
+        while (*charWrite < buffSize && ring->count < TERM_XMIT_RING_SIZE) {
+            ring->data[(ring->head + ring->count) % TERM_XMIT_RING_SIZE] = buff[*charWrite];
+            ring->count++;
+            *charWrite += 1;
+        }
+        writer->until[unit] = ring->sent + ring->count;
 
-        int control = 0x1;
-        control |= 0x2;
-        control |= 0x4;
-        control |= (buff[i] << 8);
+        int full = *charWrite < buffSize;
+        if (full) {
+            ring->waiting = 1;
+            termStats[unit].xmitStalls++;
+        }
 
-        if (USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, (void *)(long)control) != USLOSS_DEV_OK) {
-            return -1;
+        // The device only interrupts after sending a byte, so an idle
+        // transmitter is started on the way out
+        termXmitUnlock(unit);
+
+        if (full) {
+            MboxRecv(TermXmitSpace[unit], NULL, 0);
         }
-        *charWrite += 1;
     }
     return 0;
 }
 
+/*
+* Function: termXmitNext
+* Hands the byte at the head of a transmit ring to the device, unless the ring
+* is empty or the device is still sending the previous one. Caller holds
+* TermXmitLocks[unit]
+* @param unit: the terminal unit
+*/
+void termXmitNext(int unit) {
+    TermXmit *ring = &termXmit[unit];
+    if (ring->count == 0) {
+        return;
+    }
+
+    int control = 0;
+    control = USLOSS_TERM_CTRL_XMIT_INT(control);
+    control = USLOSS_TERM_CTRL_RECV_INT(control);
+    control = USLOSS_TERM_CTRL_XMIT_CHAR(control);
+    control = USLOSS_TERM_CTRL_CHAR(control, ring->data[ring->head]);
+
+    // A busy transmitter refuses the byte; its interrupt brings us back here
+    if (USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, (void *)(long)control) == USLOSS_DEV_OK) {
+        ring->head = (ring->head + 1) % TERM_XMIT_RING_SIZE;
+        ring->count--;
+        ring->sent++;
+        termStats[unit].sent++;
+    }
+}
+
+/*
+* Function: termXmitUnlock
+* Releases TermXmitLocks[unit], first sending the next byte if the device can
+* take it. If that byte went out, wakes the writer waiting for room and the
+* processes waiting for the ring to drain. Goes around again if the driver
+* found the ring locked meanwhile
+* @param unit: the terminal unit
+*/
+void termXmitUnlock(int unit) {
+    TermXmit *ring = &termXmit[unit];
+    do {
+        int sent = ring->sent;
+        ring->kick = 0;
+        termXmitNext(unit);
+
+        // only a byte going out makes room or drains anything
+        int wake = ring->sent != sent && ring->waiting;
+        if (wake) {
+            ring->waiting = 0;
+        }
+        int drainers = ring->sent != sent ? ring->drainWaiters : 0;
+        ring->drainWaiters -= drainers;
+        unlock(TermXmitLocks[unit]);
+
+        if (wake) {
+            MboxCondSend(TermXmitSpace[unit], NULL, 0);
+        }
+        for (int i = 0; i < drainers; i++) {
+            MboxCondSend(TermXmitDrained[unit], NULL, 0);
+        }
+    } while (ring->kick && MboxCondSend(TermXmitLocks[unit], NULL, 0) == 0);
+}
+
+/*
+* Function: Kernel_TermDrain
+* Waits until every byte a process has queued with TermWrite has gone to the
+* device
+* @param pid: the process
+*/
+void Kernel_TermDrain(int pid) {
+    TermWriter *writer = &termWriters[pid % MAXPROC];
+    if (writer->pid != pid) {
+        return;
+    }
+
+    for (int unit = 0; unit < USLOSS_TERM_UNITS; unit++) {
+        lock(TermXmitLocks[unit]);
+        while (termXmit[unit].sent < writer->until[unit]) {
+            termXmit[unit].drainWaiters++;
+            termXmitUnlock(unit);
+            MboxRecv(TermXmitDrained[unit], NULL, 0);
+            lock(TermXmitLocks[unit]);
+        }
+        termXmitUnlock(unit);
+        writer->until[unit] = 0;
+    }
+    writer->pid = 0;
+}
+
+/*
+* Function: terminateSysHandler
+* Handles the terminate system call by waiting for the caller's terminal output
+* to drain and freeing the disk tickets it never waited for, then passing it on
+* to phase 3
+* @param args: the system arguments
+*/
+void terminateSysHandler(USLOSS_Sysargs *args) {
+    Kernel_TermDrain(getpid());
+    diskAsyncReclaim(getpid());
+    phase3TerminateHandler(args);
+}
+
 /*
 * Function: termWriteSysHandler
 * Handles the terminal write system call
@@ -385,120 +1097,823 @@ void termWriteSysHandler(USLOSS_Sysargs *args) {
 
 /*
 * Function: DiskDriver
-* Handles disk interrupts for a specific disk unit
+* Services the request queue of a disk unit in C-SCAN order. The driver issues
+* every device operation itself and sleeps in waitDevice until it completes,
+* then wakes the process that submitted the request. Writes to the same track
+* that are queued by then are done along with it (see diskCombineWrites)
 * @param arg: the disk unit to handle
 * @return 0
 */
 int DiskDriver(char *arg) {
-    int unit;
-    int status1;
-    int status2;
-
-    if (strcmp(arg, "0") == 0) {
-        unit = 0;
-    }
-    else if (strcmp(arg, "1") == 0) {
-        unit = 1;
-    }
+    int unit = atoi(arg);
 
-    // Infinite loop to handle disk interrupts
     while (1) {
-        waitDevice(USLOSS_DISK_DEV, unit, &status1);  // wait for disk interrupt
+        lock(diskLocks[unit]);
+        DiskRequest *released = diskReleaseBarriers(&disks[unit]);
+        DiskRequest *req = diskNextRequest(&disks[unit]);
+        if (DISK_DEVICE_QUEUE && req != NULL) {
+            // The disk orders the batch itself
+            DiskRequest *last = req;
+            for (int n = 1; n < DISK_DEVICE_QUEUE && (last->next = diskNextRequest(&disks[unit])) != NULL; n++) {
+                last = last->next;
+            }
+        }
+        else if (DISK_WRITE_COMBINE && req != NULL) {
+            req = diskCombineWrites(&disks[unit], req);
+        }
+        unlock(diskLocks[unit]);
+
+        while (released != NULL) {
+            DiskRequest *next = released->next;
+            MboxSend(DiskWaitBoxes[released->pid % MAXPROC], NULL, 0);
+            released = next;
+        }
+
+        // Nothing queued, wait for diskSubmit to ring the doorbell
+        if (req == NULL) {
+            MboxRecv(DiskRequestBoxes[unit], NULL, 0);
+            continue;
+        }
 
-        // check if disk is ready to process a new request
-        USLOSS_DeviceInput(USLOSS_DISK_DEV, unit, &status2);  
-        if (status2 == USLOSS_DEV_READY) {
-            MboxCondSend(DiskRequestBoxes[unit], NULL, 0);
+        int start = currentTime();
+        if (DISK_DEVICE_QUEUE) {
+            diskServiceQueued(unit, req);
+        }
+        else {
+            int status = (req->next != NULL) ? diskServiceCombined(unit, req) : diskService(unit, req);
+            for (DiskRequest *r = req; r != NULL; r = r->next) {
+                r->status = status;
+            }
+        }
+        int end = currentTime();
+
+        // A request is gone once its submitter wakes, so step past it first
+        while (req != NULL) {
+            DiskRequest *next = req->next;
+            diskAccount(unit, req, start, end);
+            if (!DISK_CACHE_WRITEBACK && req->operation == USLOSS_DISK_WRITE && req->status == USLOSS_DEV_READY) {
+                cacheStoreWritten(unit, req);
+            }
+            if (req->done != NULL) {
+                req->done(unit, req);
+            }
+            else {
+                MboxSend(DiskWaitBoxes[req->pid % MAXPROC], NULL, 0);
+            }
+            req = next;
         }
     }
     return 0;
 }
 
 /*
-* Function: Kernel_DiskRead
-* Reads blocks from the disk
-* @param buffer: the buffer to read into
-* @param unit: the disk unit to read from
-* @param track: the track to read from
-* @param firstBlock: the first block to read from
-* @param blocks: the number of blocks to read
-* @param status: the status of the disk operation
-* @return 0 on success, -1 on failure
+* Function: diskAccount
+* Counts a request the driver has finished in the unit's diskStats
+* @param unit: the disk unit
+* @param req: the request
+* @param start: currentTime() when the driver started on it
+* @param end: currentTime() when the driver was done with it
 */
-int Kernel_DiskRead(void *buffer, int unit, int track, int firstBlock, int blocks, int *status) {
-    // Error checking
-    if (unit < 0 || unit >= USLOSS_DISK_UNITS || buffer == NULL || blocks <= 0 || track < 0 || track >= USLOSS_DISK_TRACK_SIZE || firstBlock < 0 || firstBlock >= USLOSS_DISK_TRACK_SIZE) {
-        return -1;
-    }
+void diskAccount(int unit, DiskRequest *req, int start, int end) {
+    DiskStats *stats = &diskStats[unit];
 
     lock(diskLocks[unit]);
+    stats->queueDepth--;
+    unlock(diskLocks[unit]);
 
-    disks[unit].request.opr = USLOSS_DISK_SEEK;  // use seek operation to move to the correct track
-    disks[unit].request.reg1 = (void *)(long)track;  // set the track to move to
-    USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &disks[unit].request);
-    MboxRecv(DiskRequestBoxes[unit], NULL, 0);  // wait for the seek operation to complete
+    if (req->operation != USLOSS_DISK_READ && req->operation != USLOSS_DISK_WRITE) {
+        return;
+    }
 
-    // Read the blocks from the disk
-    char readBuffer[USLOSS_DISK_SECTOR_SIZE];
-    int charsRead = 0;
-    for (int i = firstBlock; i < firstBlock + blocks; i++) {
-        int current_track = track + i / USLOSS_DISK_TRACK_SIZE;
-        int current_block = i % USLOSS_DISK_TRACK_SIZE;
-
-        if (disks[unit].current_track != current_track) {
-            disks[unit].current_track = current_track;
-            disks[unit].request.opr = USLOSS_DISK_SEEK;
-            disks[unit].request.reg1 = (void *)(long)disks[unit].current_track;
-            USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &disks[unit].request);
-            MboxRecv(DiskRequestBoxes[unit], NULL, 0);
+    int sectors = req->blocks;
+    if (req->segments != NULL) {
+        sectors = 0;
+        for (int i = 0; i < req->segmentCount; i++) {
+            sectors += req->segments[i].blocks;
         }
+    }
+    if (req->operation == USLOSS_DISK_READ) {
+        stats->reads++;
+        stats->sectorsRead += sectors;
+    }
+    else {
+        stats->writes++;
+        stats->sectorsWritten += sectors;
+    }
+
+    stats->waitTime += start - req->queued;
+    stats->serviceTime += end - start;
+    int bucket = 0;
+    while (bucket < DISK_LATENCY_BUCKETS - 1 && end - req->queued >= (1000 << bucket)) {
+        bucket++;
+    }
+    stats->latency[bucket]++;
+}
 
-        disks[unit].request.opr = USLOSS_DISK_READ;
-        disks[unit].request.reg1 = (void *)(long)current_block;
-        disks[unit].request.reg2 = readBuffer;  
+/*
+* Function: diskSubmit
+* Adds a request to a unit's queue, keeping it sorted by track (requests for
+* the same track stay in arrival order), and blocks until the driver is done
+* @param unit: the disk unit
+* @param req: the request, which must stay valid until this returns
+*/
+void diskSubmit(int unit, DiskRequest *req) {
+    req->pid = getpid();
+    diskEnqueue(unit, req);
+    MboxRecv(DiskWaitBoxes[req->pid % MAXPROC], NULL, 0);
+}
 
-        USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &disks[unit].request);
+/*
+* Function: diskEnqueue
+* Queues a request and wakes the driver without waiting for it
+* @param unit: the disk unit
+* @param req: the request
+*/
+void diskEnqueue(int unit, DiskRequest *req) {
+    req->next = NULL;
 
-        MboxRecv(DiskRequestBoxes[unit], NULL, 0);
-        memcpy((char *)buffer + charsRead, readBuffer, USLOSS_DISK_SECTOR_SIZE);
+    req->ioClass = DISK_CLASS_DEFAULT;
+    req->age = 0;
 
-        charsRead += USLOSS_DISK_SECTOR_SIZE;
+    lock(diskLocks[unit]);
+    req->seq = disks[unit].nextSeq++;
+    if (req->operation == DISK_BARRIER) {
+        req->next = disks[unit].barriers;
+        disks[unit].barriers = req;
+        unlock(diskLocks[unit]);
+        MboxCondSend(DiskRequestBoxes[unit], NULL, 0);
+        return;
     }
 
-    // Get the status of the disk operation
-    USLOSS_DeviceInput(USLOSS_DISK_DEV, unit, &status); 
+    req->queued = currentTime();
+    if (++diskStats[unit].queueDepth > diskStats[unit].maxQueueDepth) {
+        diskStats[unit].maxQueueDepth = diskStats[unit].queueDepth;
+    }
 
+    DiskRequest **link = &disks[unit].requestQueue;
+    while (*link != NULL && (*link)->track <= req->track) {
+        link = &(*link)->next;
+    }
+    req->next = *link;
+    *link = req;
     unlock(diskLocks[unit]);
 
-    return 0;
+    MboxCondSend(DiskRequestBoxes[unit], NULL, 0);
 }
 
 /*
-* Function: diskReadSysHandler
-* Handles the disk read system call
-* @param args: the system arguments
+* Function: diskNextRequest
+* Removes the next request to service: among the requests of the highest class
+* queued, the first at or past the head's track, or, once the head has passed
+* them all, the lowest track (C-SCAN). Every request of a lower class ages,
+* and moves up a class each DISK_AGING_LIMIT requests. Must hold the unit's
+* disk lock
+* @param disk: the disk unit
+* @return the request, or NULL if the queue is empty
 */
-void diskReadSysHandler(USLOSS_Sysargs *args) {
-    // Extract arguments
-    char *buffer = (char *)args->arg1;
-    int blocks = (int)(long)args->arg2;
-    int track = (int)(long)args->arg3;
-    int firstBlock = (int)(long)args->arg4;
-    int unit = (int)(long)args->arg5;
-    int status = 0;
+DiskRequest *diskNextRequest(Disk *disk) {
+    // Look the class up as late as possible: a child Spawn runs before its
+    // parent returns from Spawn may queue requests before its class is known
+    int best = DISK_CLASS_IDLE;
+    for (DiskRequest *req = disk->requestQueue; req != NULL; req = req->next) {
+        if (req->ioClass == DISK_CLASS_DEFAULT) {
+            req->ioClass = diskIoClass(req->pid);
+        }
+        if (req->ioClass < best) {
+            best = req->ioClass;
+        }
+    }
 
-    // Error checking
-    if (unit < 0 || unit >= USLOSS_DISK_UNITS) {
-        args->arg1 = (void *)(long)USLOSS_DEV_ERROR;
-        args->arg4 = (void *)(long)-1;
-        return;
+    DiskRequest **lowest = NULL;
+    DiskRequest **link = NULL;
+    for (DiskRequest **l = &disk->requestQueue; *l != NULL; l = &(*l)->next) {
+        if ((*l)->ioClass != best) {
+            continue;
+        }
+        if (lowest == NULL) {
+            lowest = l;
+        }
+        if ((*l)->track >= disk->current_track) {
+            link = l;
+            break;
+        }
     }
-    if (buffer == NULL || blocks <= 0) {
-        args->arg1 = (void *)(long)USLOSS_DEV_ERROR;
-        args->arg4 = (void *)(long)-1;
-        return;
+    if (link == NULL) {
+        link = lowest;
     }
-    if (track < 0 || track >= USLOSS_DISK_TRACK_SIZE) {
+    if (link == NULL) {
+        return NULL;
+    }
+
+    DiskRequest *req = *link;
+    *link = req->next;
+    req->next = NULL;
+
+    for (DiskRequest *other = disk->requestQueue; other != NULL; other = other->next) {
+        if (other->ioClass > best && ++other->age >= DISK_AGING_LIMIT) {
+            other->ioClass--;
+            other->age = 0;
+        }
+    }
+    return req;
+}
+
+/*
+* Function: diskReleaseBarriers
+* Removes the DiskSync callers that no queued request arrived before. Must
+* hold the unit's disk lock, and be called while no request is in service
+* @param disk: the disk unit
+* @return the released barriers, linked through next
+*/
+DiskRequest *diskReleaseBarriers(Disk *disk) {
+    int oldest = disk->nextSeq;
+    for (DiskRequest *req = disk->requestQueue; req != NULL; req = req->next) {
+        if (req->seq < oldest) {
+            oldest = req->seq;
+        }
+    }
+
+    DiskRequest *released = NULL;
+    DiskRequest **link = &disk->barriers;
+    while (*link != NULL) {
+        DiskRequest *barrier = *link;
+        if (barrier->seq < oldest) {
+            *link = barrier->next;
+            barrier->next = released;
+            released = barrier;
+        }
+        else {
+            link = &barrier->next;
+        }
+    }
+    return released;
+}
+
+/*
+* Function: diskCombineWrites
+* If req is a write within one track, takes the other such writes queued for
+* that track off the queue and chains them with it through next, in the order
+* they arrived. req was picked by class, so it need not come first. Must hold
+* the unit's disk lock
+* @param disk: the disk unit
+* @param req: the request about to be serviced
+* @return the first write of the chain, or req if there is nothing to combine
+*/
+DiskRequest *diskCombineWrites(Disk *disk, DiskRequest *req) {
+    if (req->operation != USLOSS_DISK_WRITE || req->segments != NULL || req->track >= disk->tracks ||
+        req->firstBlock + req->blocks > USLOSS_DISK_TRACK_SIZE) {
+        return req;
+    }
+
+    DiskRequest *chain = req;
+    DiskRequest **link = &disk->requestQueue;
+    while (*link != NULL && (*link)->track <= req->track) {
+        DiskRequest *other = *link;
+        if (other->track == req->track && other->operation == USLOSS_DISK_WRITE && other->segments == NULL &&
+            other->firstBlock + other->blocks <= USLOSS_DISK_TRACK_SIZE) {
+            *link = other->next;
+            DiskRequest **pos = &chain;
+            while (*pos != NULL && (*pos)->seq < other->seq) {
+                pos = &(*pos)->next;
+            }
+            other->next = *pos;
+            *pos = other;
+            disk->combinedWrites++;
+        }
+        else {
+            link = &other->next;
+        }
+    }
+    return chain;
+}
+
+/*
+* Function: diskServiceCombined
+* Performs a chain of writes to one track in a single pass over it. Where
+* writes overlap the one that arrived last wins, and each sector is written
+* once
+* @param unit: the disk unit
+* @param req: the first write, with the rest chained behind it
+* @return USLOSS_DEV_READY if every operation succeeded, USLOSS_DEV_ERROR if not
+*/
+int diskServiceCombined(int unit, DiskRequest *req) {
+    char *source[USLOSS_DISK_TRACK_SIZE];
+    memset(source, 0, sizeof(source));
+
+    int requested = 0;
+    for (DiskRequest *r = req; r != NULL; r = r->next) {
+        for (int i = 0; i < r->blocks; i++) {
+            source[r->firstBlock + i] = r->buffer + i * USLOSS_DISK_SECTOR_SIZE;
+        }
+        requested += r->blocks;
+    }
+
+    // Each run of sectors the writes cover goes out in one diskRun
+    int result = diskSeek(unit, req->track);
+    int block = 0;
+    while (block < USLOSS_DISK_TRACK_SIZE) {
+        int count = 0;
+        while (block + count < USLOSS_DISK_TRACK_SIZE && source[block + count] != NULL) {
+            memcpy(disks[unit].run + count * USLOSS_DISK_SECTOR_SIZE, source[block + count],
+                   USLOSS_DISK_SECTOR_SIZE);
+            count++;
+        }
+        if (count > 0) {
+            result |= diskRun(unit, USLOSS_DISK_WRITE, block, count);
+            requested -= count;
+        }
+        block += count + 1;
+    }
+    disks[unit].skippedSectors += requested;
+
+    return result == USLOSS_DEV_READY ? USLOSS_DEV_READY : USLOSS_DEV_ERROR;
+}
+
+/*
+* Function: diskServiceQueued
+* Hands the disk every sector of a batch of requests at once, as one
+* USLOSS_DISK_QUEUE command per run of sectors on a track, and waits for them
+* all; the disk picks the order. Sets each request's status. Only the unit's
+* driver may call this
+* @param unit: the disk unit
+* @param batch: the requests, chained through next
+*/
+void diskServiceQueued(int unit, DiskRequest *batch) {
+    DiskSlot slots[USLOSS_DISK_QUEUE_MAX];
+    memset(slots, 0, sizeof(slots));
+
+    // The size is still asked for on its own, before anything is queued
+    for (DiskRequest *req = batch; req != NULL; req = req->next) {
+        req->status = USLOSS_DEV_READY;
+        if (disks[unit].tracks == 0 && (req->operation == USLOSS_DISK_TRACKS || req->operation == USLOSS_DISK_WRITE)) {
+            req->status = diskOp(unit, USLOSS_DISK_TRACKS, &disks[unit].tracks, NULL);
+        }
+    }
+
+    for (DiskRequest *req = batch; req != NULL; req = req->next) {
+        if (req->operation == USLOSS_DISK_TRACKS || req->status != USLOSS_DEV_READY) {
+            continue;
+        }
+
+        DiskSegment whole;
+        DiskSegment *segments = req->segments;
+        int count = req->segmentCount;
+        if (segments == NULL) {
+            if (req->operation == USLOSS_DISK_WRITE && req->track >= disks[unit].tracks) {
+                req->status = USLOSS_DEV_ERROR;
+                continue;
+            }
+            whole.sector = req->track * USLOSS_DISK_TRACK_SIZE + req->firstBlock;
+            whole.blocks = req->blocks;
+            whole.buffer = req->buffer;
+            segments = &whole;
+            count = 1;
+        }
+
+        for (int s = 0; s < count; s++) {
+            USLOSS_DiskCommand command;
+            command.opr = req->operation;
+            command.buffer = segments[s].buffer;
+            int end = segments[s].sector + segments[s].blocks;
+            for (int i = segments[s].sector; i < end; i += command.count) {
+                command.track = i / USLOSS_DISK_TRACK_SIZE;
+                command.first = i % USLOSS_DISK_TRACK_SIZE;
+                command.count = USLOSS_DISK_TRACK_SIZE - command.first;
+                if (command.count > end - i) {
+                    command.count = end - i;
+                }
+
+                // A full queue, ours or the disk's, makes room one command at a time
+                int slot;
+                while ((slot = diskQueueCommand(unit, slots, req, &command)) == -1) {
+                    diskQueueWait(unit, slots);
+                }
+                if (slot == -2) {
+                    req->status = USLOSS_DEV_ERROR;
+                }
+                command.buffer = (char *)command.buffer + command.count * USLOSS_DISK_SECTOR_SIZE;
+            }
+        }
+    }
+
+    for (int i = 0; i < USLOSS_DISK_QUEUE_MAX; i++) {
+        while (slots[i].req != NULL) {
+            diskQueueWait(unit, slots);
+        }
+    }
+}
+
+/*
+* Function: diskQueueCommand
+* Hands the disk one command, tagged with a free slot that remembers its
+* request
+* @param unit: the disk unit
+* @param slots: the commands the disk holds, by tag
+* @param req: the request the command belongs to
+* @param command: the command, whose tag is filled in
+* @return the slot, -1 if every slot is taken or the disk is full, or -2 if
+* the disk refused the command outright
+*/
+int diskQueueCommand(int unit, DiskSlot *slots, DiskRequest *req, USLOSS_DiskCommand *command) {
+    int slot = 0;
+    int outstanding = 0;
+    while (slot < USLOSS_DISK_QUEUE_MAX && slots[slot].req != NULL) {
+        slot++;
+    }
+    for (int i = 0; i < USLOSS_DISK_QUEUE_MAX; i++) {
+        outstanding += slots[i].req != NULL;
+    }
+    if (slot == USLOSS_DISK_QUEUE_MAX) {
+        return -1;
+    }
+
+    command->tag = slot;
+    disks[unit].request.opr = USLOSS_DISK_QUEUE;
+    disks[unit].request.reg1 = command;
+    disks[unit].request.reg2 = NULL;
+    int result = USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &disks[unit].request);
+    if (result == USLOSS_DEV_BUSY && outstanding > 0) {
+        return -1;
+    }
+    if (result != USLOSS_DEV_OK) {
+        return -2;
+    }
+
+    slots[slot].req = req;
+    slots[slot].track = command->track;
+    return slot;
+}
+
+/*
+* Function: diskQueueWait
+* Waits for the disk to finish one queued command and frees its slot. The
+* disk finishes commands in the order it serves them, so this is also where
+* the head is followed and its seeks counted
+* @param unit: the disk unit
+* @param slots: the commands the disk holds, by tag
+*/
+void diskQueueWait(int unit, DiskSlot *slots) {
+    int status;
+    waitDevice(USLOSS_DISK_DEV, unit, &status);
+
+    DiskSlot *slot = &slots[USLOSS_DISK_STAT_TAG(status)];
+    if (USLOSS_DISK_STAT(status) != USLOSS_DEV_READY) {
+        slot->req->status = USLOSS_DEV_ERROR;
+        disks[unit].current_track = -1;
+    }
+    else if (disks[unit].current_track != slot->track) {
+        int from = disks[unit].current_track < 0 ? 0 : disks[unit].current_track;
+        diskStats[unit].seeks++;
+        diskStats[unit].seekDistance += (slot->track > from) ? slot->track - from : from - slot->track;
+        disks[unit].current_track = slot->track;
+    }
+    slot->req = NULL;
+}
+
+/*
+* Function: diskService
+* Performs one request on the device, a sector at a time. The runs of a
+* scatter-gather request are done back to back, seeking only when the next
+* sector is on another track
+* @param unit: the disk unit
+* @param req: the request
+* @return USLOSS_DEV_READY if every operation succeeded, USLOSS_DEV_ERROR if not
+*/
+int diskService(int unit, DiskRequest *req) {
+    // The size never changes, so the device is asked once, when it's first needed
+    if (disks[unit].tracks == 0 && (req->operation == USLOSS_DISK_TRACKS || req->operation == USLOSS_DISK_WRITE)) {
+        int result = diskOp(unit, USLOSS_DISK_TRACKS, &disks[unit].tracks, NULL);
+        if (req->operation == USLOSS_DISK_TRACKS) {
+            return result;
+        }
+    }
+    if (req->operation == USLOSS_DISK_TRACKS) {
+        return USLOSS_DEV_READY;
+    }
+
+    int result = USLOSS_DEV_READY;
+    DiskSegment whole;
+    DiskSegment *segments = req->segments;
+    int count = req->segmentCount;
+
+    if (segments == NULL) {
+        if (req->operation == USLOSS_DISK_WRITE && req->track >= disks[unit].tracks) {
+            return USLOSS_DEV_ERROR;
+        }
+        whole.sector = req->track * USLOSS_DISK_TRACK_SIZE + req->firstBlock;
+        whole.blocks = req->blocks;
+        whole.buffer = req->buffer;
+        segments = &whole;
+        count = 1;
+    }
+
+    for (int s = 0; s < count; s++) {
+        char *buffer = segments[s].buffer;
+        int end = segments[s].sector + segments[s].blocks;
+        for (int i = segments[s].sector; i < end; ) {
+            // Up to the end of the segment or of the track, whichever comes first
+            int current_block = i % USLOSS_DISK_TRACK_SIZE;
+            int run = USLOSS_DISK_TRACK_SIZE - current_block;
+            if (run > end - i) {
+                run = end - i;
+            }
+
+            result |= diskSeek(unit, i / USLOSS_DISK_TRACK_SIZE);
+            if (req->operation == USLOSS_DISK_WRITE) {
+                memcpy(disks[unit].run, buffer, run * USLOSS_DISK_SECTOR_SIZE);
+                result |= diskRun(unit, USLOSS_DISK_WRITE, current_block, run);
+            }
+            else {
+                result |= diskRun(unit, USLOSS_DISK_READ, current_block, run);
+                memcpy(buffer, disks[unit].run, run * USLOSS_DISK_SECTOR_SIZE);
+            }
+            buffer += run * USLOSS_DISK_SECTOR_SIZE;
+            i += run;
+        }
+    }
+
+    return result == USLOSS_DEV_READY ? USLOSS_DEV_READY : USLOSS_DEV_ERROR;
+}
+
+/*
+* Function: diskOp
+* Starts one operation on the device and waits for its interrupt. Only the
+* unit's driver may call this
+* @param unit: the disk unit
+* @param operation: the USLOSS_DISK_* operation
+* @param reg1, reg2: the operation's arguments
+* @return the device status after the operation
+*/
+int diskOp(int unit, int operation, void *reg1, void *reg2) {
+    int status;
+
+    disks[unit].request.opr = operation;
+    disks[unit].request.reg1 = reg1;
+    disks[unit].request.reg2 = reg2;
+    USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &disks[unit].request);
+    waitDevice(USLOSS_DISK_DEV, unit, &status);
+    return status;
+}
+
+/*
+* Function: diskRun
+* Moves consecutive sectors of the current track between the unit's run
+* buffer and the device. With DISK_MULTI_SECTOR a run of more than one sector
+* is a single device request; otherwise it is done a sector at a time. Only
+* the unit's driver may call this
+* @param unit: the disk unit
+* @param operation: USLOSS_DISK_READ or USLOSS_DISK_WRITE
+* @param block: the first sector on the track
+* @param count: how many sectors, from the start of disks[unit].run
+* @return the device status, USLOSS_DEV_READY only if every operation succeeded
+*/
+int diskRun(int unit, int operation, int block, int count) {
+    if (DISK_MULTI_SECTOR && count > 1) {
+        int multi = (operation == USLOSS_DISK_WRITE) ? USLOSS_DISK_WRITE_MULTI : USLOSS_DISK_READ_MULTI;
+        return diskOp(unit, multi, USLOSS_DISK_SECTORS(block, count), disks[unit].run);
+    }
+
+    int result = USLOSS_DEV_READY;
+    for (int i = 0; i < count; i++) {
+        result |= diskOp(unit, operation, (void *)(long)(block + i), disks[unit].run + i * USLOSS_DISK_SECTOR_SIZE);
+    }
+    return result;
+}
+
+/*
+* Function: diskSeek
+* Moves the head to a track, unless it is already there. Only the unit's
+* driver may call this
+* @param unit: the disk unit
+* @param track: the track
+* @return the device status of the seek, USLOSS_DEV_READY if none was needed
+*/
+int diskSeek(int unit, int track) {
+    if (disks[unit].current_track == track) {
+        return USLOSS_DEV_READY;
+    }
+
+    // The head starts on track 0; after a failed seek, count from there too
+    int from = disks[unit].current_track < 0 ? 0 : disks[unit].current_track;
+    diskStats[unit].seeks++;
+    diskStats[unit].seekDistance += (track > from) ? track - from : from - track;
+    int status = diskOp(unit, USLOSS_DISK_SEEK, (void *)(long)track, NULL);
+
+    // A failed seek leaves the head where it was, which may not be where we think
+    disks[unit].current_track = (status == USLOSS_DEV_READY) ? track : -1;
+    return status;
+}
+
+/*
+* Function: diskTracks
+* Gets the number of tracks on a disk, waiting for the driver only if no one
+* has needed it yet
+* @param unit: the disk unit
+* @return the number of tracks
+*/
+int diskTracks(int unit) {
+    if (disks[unit].tracks == 0) {
+        int sector, trackSize, disk;
+        Kernel_DiskSize(unit, &sector, &trackSize, &disk);
+    }
+    return disks[unit].tracks;
+}
+
+/*
+* Function: Kernel_DiskRead
+* Reads blocks from the disk
+* @param buffer: the buffer to read into
+* @param unit: the disk unit to read from
+* @param track: the track to read from
+* @param firstBlock: the first block to read from
+* @param blocks: the number of blocks to read
+* @param status: the status of the disk operation
+* @return 0 on success, -1 on failure
+*/
+int Kernel_DiskRead(void *buffer, int unit, int track, int firstBlock, int blocks, int *status) {
+    // Error checking
+    if (unit < 0 || unit >= USLOSS_DISK_UNITS || buffer == NULL || blocks <= 0 || track < 0 || track >= USLOSS_DISK_TRACK_SIZE || firstBlock < 0 || firstBlock >= USLOSS_DISK_TRACK_SIZE) {
+        return -1;
+    }
+
+    char *buff = buffer;
+    int first = track * USLOSS_DISK_TRACK_SIZE + firstBlock;
+    int i = 0;
+    *status = USLOSS_DEV_READY;
+
+    while (i < blocks) {
+        // Copy out the cached sectors, then find the run of sectors that aren't
+        lock(cacheLock);
+        CacheBlock *block;
+        while (i < blocks && (block = cacheLookup(unit, first + i)) != NULL) {
+            memcpy(buff + i * USLOSS_DISK_SECTOR_SIZE, block->data, USLOSS_DISK_SECTOR_SIZE);
+            cacheTouch(block);
+            diskCacheStats.hits++;
+            i++;
+        }
+        int run = 0;
+        while (i + run < blocks && cacheLookup(unit, first + i + run) == NULL) {
+            run++;
+        }
+        unlock(cacheLock);
+
+        if (run == 0) {
+            break;
+        }
+
+        // Read the missing run straight into the caller's buffer
+        int result = diskTransfer(USLOSS_DISK_READ, unit, track, firstBlock + i, run,
+                                  buff + i * USLOSS_DISK_SECTOR_SIZE);
+        diskCacheStats.misses += run;
+        if (result != USLOSS_DEV_READY) {
+            *status = result;
+            return 0;
+        }
+
+        // A write may have cached newer data while we were reading, so keep it
+        lock(cacheLock);
+        for (int j = i; j < i + run; j++) {
+            if (cacheLookup(unit, first + j) == NULL) {
+                block = cacheInsert(unit, first + j);
+                memcpy(block->data, buff + j * USLOSS_DISK_SECTOR_SIZE, USLOSS_DISK_SECTOR_SIZE);
+            }
+        }
+        unlock(cacheLock);
+        i += run;
+    }
+
+    diskReadAhead(unit, first, blocks);
+    return 0;
+}
+
+/*
+* Function: diskReadAhead
+* Updates the caller's read-ahead window after a read, and if the read was
+* sequential starts prefetching the sectors that follow it into the cache.
+* The driver finishes the prefetch on its own; nobody waits for it
+* @param unit: the disk unit
+* @param firstSector: the first sector the caller read
+* @param blocks: the number of sectors read
+*/
+void diskReadAhead(int unit, int firstSector, int blocks) {
+    int pid = getpid();
+    ReadAhead *ra = &readAhead[pid % MAXPROC][unit];
+    if (ra->pid != pid) {
+        ra->pid = pid;
+        ra->window = 0;
+    }
+    else if (firstSector == ra->nextSector) {
+        ra->window = ra->window == 0 ? READAHEAD_MIN_WINDOW : ra->window * 2;
+        if (ra->window > READAHEAD_MAX_WINDOW) {
+            ra->window = READAHEAD_MAX_WINDOW;
+        }
+    }
+    else {
+        ra->window /= 2;
+    }
+    ra->nextSector = firstSector + blocks;
+
+    // Never past the end of the next track, or of the disk
+    int start = ra->nextSector;
+    int end = start + ra->window;
+    int limit = (start / USLOSS_DISK_TRACK_SIZE + 2) * USLOSS_DISK_TRACK_SIZE;
+    if (end > limit) {
+        end = limit;
+    }
+    if (disks[unit].tracks > 0 && end > disks[unit].tracks * USLOSS_DISK_TRACK_SIZE) {
+        end = disks[unit].tracks * USLOSS_DISK_TRACK_SIZE;
+    }
+
+    // Prefetch the first run of sectors in that range that isn't cached
+    lock(cacheLock);
+    while (start < end && cacheLookup(unit, start) != NULL) {
+        start++;
+    }
+    int count = 0;
+    while (start + count < end && cacheLookup(unit, start + count) == NULL) {
+        count++;
+    }
+    unlock(cacheLock);
+
+    if (count == 0 || readAheadBusy[unit]) {
+        return;
+    }
+    readAheadBusy[unit] = 1;
+
+    DiskRequest *req = &readAheadReq[unit];
+    req->operation = USLOSS_DISK_READ;
+    req->track = start / USLOSS_DISK_TRACK_SIZE;
+    req->firstBlock = start % USLOSS_DISK_TRACK_SIZE;
+    req->blocks = count;
+    req->buffer = readAheadData[unit];
+    req->segments = NULL;
+    req->pid = -1;
+    req->done = diskReadAheadDone;
+    diskEnqueue(unit, req);
+}
+
+/*
+* Function: diskReadAheadDone
+* Called by the driver when a prefetch finishes. Adds whatever sectors it can
+* to the cache without blocking (see cacheFill)
+* @param unit: the disk unit
+* @param req: the prefetch request
+*/
+void diskReadAheadDone(int unit, DiskRequest *req) {
+    if (req->status == USLOSS_DEV_READY) {
+        int first = req->track * USLOSS_DISK_TRACK_SIZE + req->firstBlock;
+        diskCacheStats.readAheads += cacheFill(unit, first, req->blocks, req->buffer);
+    }
+    readAheadBusy[unit] = 0;
+}
+
+/*
+* Function: diskTransfer
+* Reads or writes a run of sectors through the unit's request queue
+* @param operation: USLOSS_DISK_READ or USLOSS_DISK_WRITE
+* @param unit, track, firstBlock, blocks: where on the disk
+* @param buffer: the data
+* @return the device status of the request
+*/
+int diskTransfer(int operation, int unit, int track, int firstBlock, int blocks, char *buffer) {
+    DiskRequest req;
+    req.operation = operation;
+    req.track = track;
+    req.firstBlock = firstBlock;
+    req.blocks = blocks;
+    req.buffer = buffer;
+    req.segments = NULL;
+    req.done = NULL;
+    diskSubmit(unit, &req);
+    return req.status;
+}
+
+/*
+* Function: diskReadSysHandler
+* Handles the disk read system call
+* @param args: the system arguments
+*/
+void diskReadSysHandler(USLOSS_Sysargs *args) {
+    // Extract arguments
+    char *buffer = (char *)args->arg1;
+    int blocks = (int)(long)args->arg2;
+    int track = (int)(long)args->arg3;
+    int firstBlock = (int)(long)args->arg4;
+    int unit = (int)(long)args->arg5;
+    int status = 0;
+
+    // Error checking
+    if (unit < 0 || unit >= USLOSS_DISK_UNITS) {
+        args->arg1 = (void *)(long)USLOSS_DEV_ERROR;
+        args->arg4 = (void *)(long)-1;
+        return;
+    }
+    if (buffer == NULL || blocks <= 0) {
+        args->arg1 = (void *)(long)USLOSS_DEV_ERROR;
+        args->arg4 = (void *)(long)-1;
+        return;
+    }
+    if (track < 0 || track >= USLOSS_DISK_TRACK_SIZE) {
         args->arg1 = (void *)(long)USLOSS_DEV_ERROR;
         args->arg4 = 0;
         return;
@@ -518,65 +1933,457 @@ void diskReadSysHandler(USLOSS_Sysargs *args) {
 }
 
 /*
-* Function: Kernel_DiskWrite
-* Writes blocks to the disk
-* @param buffer: the buffer to write from
-* @param unit: the disk unit to write to
-* @param track: the track to write to
-* @param firstBlock: the first block to write to
-* @param blocks: the number of blocks to write
-* @param status: the status of the disk operation
-* @return 0 on success, -1 on failure
+* Function: diskAsyncSysHandler
+* Handles the asynchronous disk system call. arg1 is the operation: for
+* USLOSS_DISK_READ and USLOSS_DISK_WRITE arg2 points to a DiskAsyncRequest and
+* the ticket is returned in arg1; for DISK_ASYNC_WAIT arg2 is the ticket and
+* the request's status is returned in arg1; for DISK_SET_CLASS arg2 is the class
+* @param args: the system arguments
 */
-int Kernel_DiskWrite(void *buffer, int unit, int track, int firstBlock, int blocks, int *status) {
-    lock(diskLocks[unit]);
+void diskAsyncSysHandler(USLOSS_Sysargs *args) {
+    int operation = (int)(long)args->arg1;
+    int result = 0;
+    int sysStat;
 
-    disks[unit].request.opr = USLOSS_DISK_TRACKS;  // set the operation to get the number of tracks on the disk
-    disks[unit].request.reg1 = &disks[unit].tracks;  // set the reg1 to store the number of tracks
-    USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &disks[unit].request);
-    MboxRecv(DiskRequestBoxes[unit], NULL, 0);
+    if (operation == DISK_ASYNC_WAIT) {
+        sysStat = Kernel_DiskWait((int)(long)args->arg2, &result);
+    }
+    else if (operation == DISK_SET_CLASS) {
+        sysStat = Kernel_DiskSetClass((int)(long)args->arg2);
+    }
+    else {
+        sysStat = Kernel_DiskAsync(operation, (DiskAsyncRequest *)args->arg2, &result);
+    }
 
-    if (track >= disks[unit].tracks) {
-        unlock(diskLocks[unit]);
-        return USLOSS_DEV_ERROR;
+    args->arg1 = (void *)(long)result;
+    args->arg4 = (void *)(long)sysStat;
+}
+
+/*
+* Function: Kernel_DiskAsync
+* Starts a read or write and returns without waiting for it. A read that is
+* already cached, and a write to a write-back cache, complete right away
+* @param operation: USLOSS_DISK_READ or USLOSS_DISK_WRITE
+* @param request: what to transfer, and where to post the completion
+* @param ticket: the ticket to pass to DiskWait
+* @return 0 on success, -1 for bad arguments or if no ticket is free
+*/
+int Kernel_DiskAsync(int operation, DiskAsyncRequest *request, int *ticket) {
+    if (request == NULL || (operation != USLOSS_DISK_READ && operation != USLOSS_DISK_WRITE)) {
+        return -1;
+    }
+    int unit = request->unit;
+    if (unit < 0 || unit >= USLOSS_DISK_UNITS || request->buffer == NULL || request->sectors <= 0 ||
+        request->track < 0 || request->first < 0 || request->first >= USLOSS_DISK_TRACK_SIZE) {
+        return -1;
     }
 
-    disks[unit].request.opr = USLOSS_DISK_SEEK;
-    disks[unit].request.reg1 = (void *)(long)track;  // set the track to move to
+    // A write-back write completes before the device sees it, so catch bad tracks here
+    int first = request->track * USLOSS_DISK_TRACK_SIZE + request->first;
+    if ((first + request->sectors - 1) / USLOSS_DISK_TRACK_SIZE >= diskTracks(unit)) {
+        return -1;
+    }
 
-    USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &disks[unit].request);
-    MboxRecv(DiskRequestBoxes[unit], NULL, 0);
+    lock(asyncLock);
+    AsyncTicket *t = NULL;
+    for (int i = 0; i < DISK_ASYNC_TICKETS; i++) {
+        if (!asyncTickets[i].inUse) {
+            t = &asyncTickets[i];
+            t->inUse = 1;
+            t->waited = 0;
+            t->done = 0;
+            t->orphaned = 0;
+            t->ticket = asyncSeq++ * DISK_ASYNC_TICKETS + i;
+            break;
+        }
+    }
+    unlock(asyncLock);
+    if (t == NULL) {
+        return -1;
+    }
 
-    // Write the blocks to the disk
-    int charsWrite = 0;
-    for (int i = firstBlock; i < firstBlock + blocks; i++) {
-        int current_track = track + i / USLOSS_DISK_TRACK_SIZE;
-        int current_block = i % USLOSS_DISK_TRACK_SIZE;
+    t->mbox = request->mbox;
+    t->req.operation = operation;
+    t->req.track = request->track;
+    t->req.firstBlock = request->first;
+    t->req.blocks = request->sectors;
+    t->req.buffer = request->buffer;
+    t->req.segments = NULL;
+    t->req.pid = getpid();
+    t->req.status = USLOSS_DEV_READY;
+    t->req.done = diskAsyncDone;
+    *ticket = t->ticket;
+
+    if (operation == USLOSS_DISK_WRITE) {
+        // Written through, the driver puts the data in the cache once it is on the device
+        if (!DISK_CACHE_WRITEBACK) {
+            diskEnqueue(unit, &t->req);
+            return 0;
+        }
+        cacheStore(unit, first, request->sectors, request->buffer, 1);
+    }
+    else {
+        lock(cacheLock);
+        int cached = 0;
+        while (cached < request->sectors && cacheLookup(unit, first + cached) != NULL) {
+            cached++;
+        }
+        if (cached < request->sectors) {
+            unlock(cacheLock);
+            diskCacheStats.misses += request->sectors;
+            diskEnqueue(unit, &t->req);
+            return 0;
+        }
+        for (int i = 0; i < request->sectors; i++) {
+            CacheBlock *block = cacheLookup(unit, first + i);
+            memcpy(t->req.buffer + i * USLOSS_DISK_SECTOR_SIZE, block->data, USLOSS_DISK_SECTOR_SIZE);
+            cacheTouch(block);
+        }
+        diskCacheStats.hits += request->sectors;
+        unlock(cacheLock);
+    }
+
+    diskAsyncDone(unit, &t->req);
+    return 0;
+}
 
-        if (disks[unit].current_track != current_track) {
-            disks[unit].current_track = current_track;
-            disks[unit].request.opr = USLOSS_DISK_SEEK;
-            disks[unit].request.reg1 = (void *)(long)disks[unit].current_track;
-            USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &disks[unit].request);
-            MboxRecv(DiskRequestBoxes[unit], NULL, 0);  // wait for seek to complete
+/*
+* Function: diskAsyncDone
+* Completes an asynchronous request, usually in the driver, so nothing here
+* may wait on the caller: the completion is dropped if its mailbox is full. A
+* completion that reaches the mailbox frees the ticket, unless someone is
+* already in DiskWait for it, and so does one whose process has quit
+* @param unit: the disk unit
+* @param req: the request, the first member of its AsyncTicket
+*/
+void diskAsyncDone(int unit, DiskRequest *req) {
+    AsyncTicket *t = (AsyncTicket *)req;
+
+    if (req->operation == USLOSS_DISK_READ && req->status == USLOSS_DEV_READY) {
+        cacheFill(unit, req->track * USLOSS_DISK_TRACK_SIZE + req->firstBlock, req->blocks, req->buffer);
+    }
+
+    lock(asyncLock);
+    int delivered = 0;
+    if (t->mbox >= 0) {
+        DiskCompletion completion;
+        completion.ticket = t->ticket;
+        completion.status = req->status;
+        delivered = (MboxCondSend(t->mbox, &completion, sizeof(completion)) == 0);
+    }
+    if (!t->waited && (delivered || t->orphaned)) {
+        t->inUse = 0;
+    }
+    else {
+        t->done = 1;
+        MboxCondSend(t->doneBox, NULL, 0);
+    }
+    unlock(asyncLock);
+}
+
+/*
+* Function: diskAsyncReclaim
+* Frees the tickets of a process that quits without waiting for them. A ticket
+* whose request is still running is marked, and diskAsyncDone frees it
+* @param pid: the process
+*/
+void diskAsyncReclaim(int pid) {
+    lock(asyncLock);
+    for (int i = 0; i < DISK_ASYNC_TICKETS; i++) {
+        AsyncTicket *t = &asyncTickets[i];
+        if (!t->inUse || t->req.pid != pid || t->waited) {
+            continue;
+        }
+        if (t->done) {
+            MboxCondRecv(t->doneBox, NULL, 0);
+            t->inUse = 0;
+        }
+        else {
+            t->orphaned = 1;
+        }
+    }
+    unlock(asyncLock);
+}
+
+/*
+* Function: Kernel_DiskWait
+* Waits for an asynchronous request to complete and frees its ticket
+* @param ticket: the ticket from Kernel_DiskAsync
+* @param status: the device status of the request
+* @return 0 on success, -1 if the ticket isn't outstanding, which includes one
+*         whose completion has been delivered to its mailbox
+*/
+int Kernel_DiskWait(int ticket, int *status) {
+    if (ticket < 0) {
+        return -1;
+    }
+    AsyncTicket *t = &asyncTickets[ticket % DISK_ASYNC_TICKETS];
+
+    lock(asyncLock);
+    if (!t->inUse || t->ticket != ticket || t->waited) {
+        unlock(asyncLock);
+        return -1;
+    }
+    t->waited = 1;
+    unlock(asyncLock);
+
+    MboxRecv(t->doneBox, NULL, 0);
+    *status = t->req.status;
+
+    lock(asyncLock);
+    t->inUse = 0;
+    unlock(asyncLock);
+    return 0;
+}
+
+/*
+* Function: diskIoVSysHandler
+* Handles the scatter-gather disk system call: arg1 is USLOSS_DISK_READ or
+* USLOSS_DISK_WRITE, arg2 the DiskIoVec array, arg3 its length and arg4 the
+* unit. The device status is returned in arg1
+* @param args: the system arguments
+*/
+void diskIoVSysHandler(USLOSS_Sysargs *args) {
+    int operation = (int)(long)args->arg1;
+    DiskIoVec *iov = (DiskIoVec *)args->arg2;
+    int count = (int)(long)args->arg3;
+    int unit = (int)(long)args->arg4;
+    int status = USLOSS_DEV_ERROR;
+
+    int sysStat = Kernel_DiskIoV(operation, unit, iov, count, &status);
+
+    args->arg1 = (void *)(long)status;
+    args->arg4 = (void *)(long)sysStat;
+}
+
+/*
+* Function: Kernel_DiskIoV
+* Reads or writes a list of runs on one unit with a single request. The runs
+* are sorted by sector so the driver makes one pass over the disk, and runs
+* that continue where the previous one ended need no seek of their own. Reads
+* skip runs that are already cached; writes go through the cache like DiskWrite
+* @param operation: USLOSS_DISK_READ or USLOSS_DISK_WRITE
+* @param unit: the disk unit
+* @param iov: the runs, at most DISK_IOV_MAX of them
+* @param count: the number of runs
+* @param status: the device status of the request
+* @return 0 on success, -1 for bad arguments
+*/
+int Kernel_DiskIoV(int operation, int unit, DiskIoVec *iov, int count, int *status) {
+    if ((operation != USLOSS_DISK_READ && operation != USLOSS_DISK_WRITE) ||
+        unit < 0 || unit >= USLOSS_DISK_UNITS || iov == NULL || count <= 0 || count > DISK_IOV_MAX) {
+        return -1;
+    }
+
+    int diskSectors = diskTracks(unit) * USLOSS_DISK_TRACK_SIZE;
+
+    // Sort the runs by sector (insertion sort keeps equal runs in the caller's order)
+    DiskSegment segments[DISK_IOV_MAX];
+    for (int i = 0; i < count; i++) {
+        if (iov[i].buffer == NULL || iov[i].sectors <= 0 || iov[i].track < 0 ||
+            iov[i].first < 0 || iov[i].first >= USLOSS_DISK_TRACK_SIZE) {
+            return -1;
         }
+        DiskSegment seg;
+        seg.sector = iov[i].track * USLOSS_DISK_TRACK_SIZE + iov[i].first;
+        seg.blocks = iov[i].sectors;
+        seg.buffer = iov[i].buffer;
+        if (seg.sector + seg.blocks > diskSectors) {
+            return -1;
+        }
+
+        int j = i;
+        while (j > 0 && segments[j - 1].sector > seg.sector) {
+            segments[j] = segments[j - 1];
+            j--;
+        }
+        segments[j] = seg;
+    }
 
-        // Write data to disk
-        char writing[USLOSS_DISK_SECTOR_SIZE];
-        memcpy(writing, (char *)buffer + charsWrite, USLOSS_DISK_SECTOR_SIZE);
-        disks[unit].request.opr = USLOSS_DISK_WRITE;
-        disks[unit].request.reg1 = (void *)(long)current_block;
-        disks[unit].request.reg2 = writing;
+    if (operation == USLOSS_DISK_WRITE) {
+        for (int i = 1; i < count; i++) {
+            if (segments[i - 1].sector + segments[i - 1].blocks > segments[i].sector) {
+                return -1;
+            }
+        }
+    }
 
-        USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &disks[unit].request);
+    *status = USLOSS_DEV_READY;
 
-        MboxRecv(DiskRequestBoxes[unit], NULL, 0);
+    // Only the runs that aren't entirely cached need the device
+    int misses = 0;
+    if (operation == USLOSS_DISK_READ) {
+        lock(cacheLock);
+        for (int i = 0; i < count; i++) {
+            int cached = 0;
+            while (cached < segments[i].blocks && cacheLookup(unit, segments[i].sector + cached) != NULL) {
+                cached++;
+            }
+            if (cached < segments[i].blocks) {
+                segments[misses++] = segments[i];
+                continue;
+            }
+            for (int j = 0; j < segments[i].blocks; j++) {
+                CacheBlock *block = cacheLookup(unit, segments[i].sector + j);
+                memcpy(segments[i].buffer + j * USLOSS_DISK_SECTOR_SIZE, block->data, USLOSS_DISK_SECTOR_SIZE);
+                cacheTouch(block);
+            }
+            diskCacheStats.hits += segments[i].blocks;
+        }
+        unlock(cacheLock);
+    }
+    else if (!DISK_CACHE_WRITEBACK) {
+        misses = count;
+    }
 
-        charsWrite += USLOSS_DISK_SECTOR_SIZE;
+    if (misses > 0) {
+        DiskRequest req;
+        req.operation = operation;
+        req.track = segments[0].sector / USLOSS_DISK_TRACK_SIZE;
+        req.firstBlock = segments[0].sector % USLOSS_DISK_TRACK_SIZE;
+        req.blocks = 0;
+        req.buffer = NULL;
+        req.segments = segments;
+        req.segmentCount = misses;
+        req.done = NULL;
+        diskSubmit(unit, &req);
+        *status = req.status;
     }
-    USLOSS_DeviceInput(USLOSS_DISK_DEV, unit, &status);
 
-    unlock(diskLocks[unit]);
+    if (operation == USLOSS_DISK_WRITE) {
+        for (int i = 0; i < count && DISK_CACHE_WRITEBACK; i++) {
+            cacheStore(unit, segments[i].sector, segments[i].blocks, segments[i].buffer, 1);
+        }
+        return 0;
+    }
+
+    // The cache may have newer data than the device, so it wins
+    lock(cacheLock);
+    for (int i = 0; i < misses && *status == USLOSS_DEV_READY; i++) {
+        diskCacheStats.misses += segments[i].blocks;
+        for (int j = 0; j < segments[i].blocks; j++) {
+            char *data = segments[i].buffer + j * USLOSS_DISK_SECTOR_SIZE;
+            CacheBlock *block = cacheLookup(unit, segments[i].sector + j);
+            if (block != NULL) {
+                memcpy(data, block->data, USLOSS_DISK_SECTOR_SIZE);
+                cacheTouch(block);
+            }
+            else {
+                block = cacheInsert(unit, segments[i].sector + j);
+                memcpy(block->data, data, USLOSS_DISK_SECTOR_SIZE);
+            }
+        }
+    }
+    unlock(cacheLock);
+    return 0;
+}
+
+/*
+* Function: Kernel_DiskSetClass
+* Sets the I/O class of the calling process's disk requests
+* @param ioClass: a DISK_CLASS_* class, or DISK_CLASS_DEFAULT for the class that
+* goes with the process's priority
+* @return 0 on success, -1 for a bad class
+*/
+int Kernel_DiskSetClass(int ioClass) {
+    if (ioClass < DISK_CLASS_DEFAULT || ioClass > DISK_CLASS_IDLE) {
+        return -1;
+    }
+
+    int pid = getpid();
+    IoClass *entry = &ioClasses[pid % MAXPROC];
+    if (entry->pid != pid) {
+        entry->pid = pid;
+        entry->priorityClass = DISK_CLASS_NORMAL;
+    }
+    entry->ioClass = ioClass;
+    return 0;
+}
+
+/*
+* Function: diskIoClass
+* Gets the I/O class of a process's disk requests. Processes Spawn didn't
+* create are normal, and requests no process waits for (pid -1) are idle
+* @param pid: the process
+* @return the DISK_CLASS_* class
+*/
+int diskIoClass(int pid) {
+    if (pid < 0) {
+        return DISK_CLASS_IDLE;
+    }
+
+    IoClass *entry = &ioClasses[pid % MAXPROC];
+    if (entry->pid != pid) {
+        return DISK_CLASS_NORMAL;
+    }
+    return entry->ioClass != DISK_CLASS_DEFAULT ? entry->ioClass : entry->priorityClass;
+}
+
+/*
+* Function: spawnSysHandler
+* Handles the spawn system call by passing it on to phase 3, then records the
+* I/O class that goes with the new process's priority. A child of higher
+* priority has already run, and keeps any class it set itself. Phase 3 returns
+* in user mode, so this only touches memory afterwards
+* @param args: the system arguments
+*/
+void spawnSysHandler(USLOSS_Sysargs *args) {
+    int priority = (int)(long)args->arg4;
+
+    phase3SpawnHandler(args);
+
+    int pid = (int)(long)args->arg1;
+    if ((long)args->arg4 != 0 || pid < 0) {
+        return;
+    }
+    IoClass *entry = &ioClasses[pid % MAXPROC];
+    if (entry->pid != pid) {
+        entry->pid = pid;
+        entry->ioClass = DISK_CLASS_DEFAULT;
+    }
+    if (priority <= 1) {
+        entry->priorityClass = DISK_CLASS_REALTIME;
+    }
+    else if (priority >= 5) {
+        entry->priorityClass = DISK_CLASS_IDLE;
+    }
+    else {
+        entry->priorityClass = DISK_CLASS_NORMAL;
+    }
+}
+
+/*
+* Function: Kernel_DiskWrite
+* Writes blocks to the disk
+* @param buffer: the buffer to write from
+* @param unit: the disk unit to write to
+* @param track: the track to write to
+* @param firstBlock: the first block to write to
+* @param blocks: the number of blocks to write
+* @param status: the status of the disk operation
+* @return 0 on success, USLOSS_DEV_ERROR if the track is past the end of the disk
+*/
+int Kernel_DiskWrite(void *buffer, int unit, int track, int firstBlock, int blocks, int *status) {
+    char *buff = buffer;
+    int first = track * USLOSS_DISK_TRACK_SIZE + firstBlock;
+
+    if (DISK_CACHE_WRITEBACK) {
+        // Nothing reaches the device yet, so check the disk's size up front
+        if ((first + blocks - 1) / USLOSS_DISK_TRACK_SIZE >= diskTracks(unit)) {
+            *status = USLOSS_DEV_ERROR;
+            return USLOSS_DEV_ERROR;
+        }
+        cacheStore(unit, first, blocks, buff, 1);
+    }
+    else {
+        // The driver updates the cache (see cacheStoreWritten)
+        *status = diskTransfer(USLOSS_DISK_WRITE, unit, track, firstBlock, blocks, buff);
+        if (*status == USLOSS_DEV_ERROR) {
+            return USLOSS_DEV_ERROR;
+        }
+    }
+
+    *status = USLOSS_DEV_READY;
     return 0;
 }
 
@@ -638,22 +2445,25 @@ void diskWriteSysHandler(USLOSS_Sysargs *args) {
 * @return 0 on success, -1 on failure
 */
 int Kernel_DiskSize(int unit, int *sector, int *track, int *disk) {
-    lock(diskLocks[unit]);
-
-    disks[unit].request.opr = USLOSS_DISK_TRACKS;  // set the operation to get the number of tracks on the disk
-    disks[unit].request.reg1 = &disks[unit].tracks;  // set the reg1 to store the number of tracks
+    // Only the first time. The driver answers a tracks request as soon as
+    // the current one finishes
+    if (disks[unit].tracks == 0) {
+        DiskRequest req;
+        req.operation = USLOSS_DISK_TRACKS;
+        req.track = disks[unit].current_track;
+        req.firstBlock = 0;
+        req.blocks = 0;
+        req.buffer = NULL;
+        req.segments = NULL;
+        req.done = NULL;
+        diskSubmit(unit, &req);
+    }
 
-    // Send the request to the disk
-    USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &disks[unit].request);
-    MboxRecv(DiskRequestBoxes[unit], NULL, 0);
- 
     // Set out parameters and disk struct values
     *sector = disks[unit].sector_size = USLOSS_DISK_SECTOR_SIZE;
     *track = disks[unit].track_size = USLOSS_DISK_TRACK_SIZE;
     *disk = disks[unit].disk_size = disks[unit].tracks;
 
-    unlock(diskLocks[unit]);
-
     return 0;
 }
 
@@ -674,6 +2484,371 @@ void diskSizeSysHandler(USLOSS_Sysargs *args) {
     args->arg4 = (void *)(long)sysStat;
 }
 
+/*
+* Function: Kernel_DiskSync
+* Writes back the unit's dirty cache blocks, then waits until every request
+* queued on the unit before this call has completed
+* @param unit: the disk unit
+* @return 0 on success, -1 for a bad unit
+*/
+int Kernel_DiskSync(int unit) {
+    if (unit < 0 || unit >= USLOSS_DISK_UNITS) {
+        return -1;
+    }
+
+    lock(cacheLock);
+    cacheFlushUnit(unit);
+    unlock(cacheLock);
+
+    DiskRequest req;
+    req.operation = DISK_BARRIER;
+    req.track = 0;
+    req.firstBlock = 0;
+    req.blocks = 0;
+    req.buffer = NULL;
+    req.segments = NULL;
+    req.done = NULL;
+    diskSubmit(unit, &req);
+    return 0;
+}
+
+/*
+* Function: diskSyncSysHandler
+* Handles the disk sync system call
+* @param args: the system arguments
+*/
+void diskSyncSysHandler(USLOSS_Sysargs *args) {
+    args->arg4 = (void *)(long)Kernel_DiskSync((int)(long)args->arg1);
+}
+
+/*
+* Function: Kernel_DeviceStats
+* Copies a device unit's counters
+* @param type: USLOSS_DISK_DEV or USLOSS_TERM_DEV
+* @param unit: the unit
+* @param stats: a DiskStats or a TermStats, going by type
+* @return 0 on success, -1 for a bad type or unit
+*/
+int Kernel_DeviceStats(int type, int unit, void *stats) {
+    if (stats == NULL) {
+        return -1;
+    }
+    if (type == USLOSS_DISK_DEV && unit >= 0 && unit < USLOSS_DISK_UNITS) {
+        memcpy(stats, &diskStats[unit], sizeof(DiskStats));
+        return 0;
+    }
+    if (type == USLOSS_TERM_DEV && unit >= 0 && unit < USLOSS_TERM_UNITS) {
+        memcpy(stats, &termStats[unit], sizeof(TermStats));
+        return 0;
+    }
+    return -1;
+}
+
+/*
+* Function: deviceStatsSysHandler
+* Handles the device stats system call
+* @param args: the system arguments
+*/
+void deviceStatsSysHandler(USLOSS_Sysargs *args) {
+    int type = (int)(long)args->arg1;
+    int unit = (int)(long)args->arg2;
+    args->arg4 = (void *)(long)Kernel_DeviceStats(type, unit, args->arg3);
+}
+
+/*
+* Function: DiskFlusher
+* Writes the dirty blocks in the cache back to disk every DISK_CACHE_FLUSH_SECS
+* seconds. Only started when the cache is write-back
+* @param arg: unused
+* @return 0
+*/
+int DiskFlusher(char *arg) {
+    while (1) {
+        Kernel_Sleep(DISK_CACHE_FLUSH_SECS);
+        lock(cacheLock);
+        cacheFlush();
+        unlock(cacheLock);
+    }
+    return 0;
+}
+
+/*
+* Function: cacheLookup
+* Finds the cache block holding a sector. Must hold cacheLock
+* @param unit: the disk unit
+* @param sector: the sector number, counted from the start of the disk
+* @return the block, or NULL if the sector isn't cached
+*/
+CacheBlock *cacheLookup(int unit, int sector) {
+    CacheBlock *block = cacheHash[(sector * USLOSS_DISK_UNITS + unit) % DISK_CACHE_HASH_SIZE];
+    while (block != NULL && (block->unit != unit || block->sector != sector)) {
+        block = block->hashNext;
+    }
+    return block;
+}
+
+/*
+* Function: cacheInsert
+* Reuses the least recently used block for a sector that isn't cached yet,
+* writing it back first if it is dirty. The caller fills in the data. Must
+* hold cacheLock, which is kept across the write back so no one can read the
+* old sector from the device before it lands
+* @param unit: the disk unit
+* @param sector: the sector number, counted from the start of the disk
+* @return the block, now the most recently used
+*/
+CacheBlock *cacheInsert(int unit, int sector) {
+    CacheBlock *block = cacheLRU;
+    if (block->valid) {
+        if (block->dirty) {
+            cacheWriteBack(block);
+        }
+
+        // unhash the old sector
+        CacheBlock **link = &cacheHash[(block->sector * USLOSS_DISK_UNITS + block->unit) % DISK_CACHE_HASH_SIZE];
+        while (*link != block) {
+            link = &(*link)->hashNext;
+        }
+        *link = block->hashNext;
+        diskCacheStats.evictions++;
+    }
+
+    block->unit = unit;
+    block->sector = sector;
+    block->valid = 1;
+    block->dirty = 0;
+    int bucket = (sector * USLOSS_DISK_UNITS + unit) % DISK_CACHE_HASH_SIZE;
+    block->hashNext = cacheHash[bucket];
+    cacheHash[bucket] = block;
+    cacheTouch(block);
+    return block;
+}
+
+/*
+* Function: cacheStore
+* Puts freshly written data in the cache, replacing what was there
+* @param unit: the disk unit
+* @param first: the first sector, counted from the start of the disk
+* @param blocks: the number of sectors
+* @param buff: the data
+* @param dirty: whether the device still has to be written
+*/
+void cacheStore(int unit, int first, int blocks, char *buff, int dirty) {
+    lock(cacheLock);
+    for (int i = 0; i < blocks; i++) {
+        CacheBlock *block = cacheLookup(unit, first + i);
+        if (block == NULL) {
+            block = cacheInsert(unit, first + i);
+        }
+        else {
+            cacheTouch(block);
+        }
+        memcpy(block->data, buff + i * USLOSS_DISK_SECTOR_SIZE, USLOSS_DISK_SECTOR_SIZE);
+        block->dirty = dirty;
+    }
+    unlock(cacheLock);
+}
+
+/*
+* Function: cacheStoreWritten
+* Puts the data of a write the driver has just finished in the cache. Writes
+* are stored in the order they reach the device, so where two overlap the
+* cache ends up with what the device has. Only used when writing through:
+* then no one holding cacheLock waits on the driver, so it can block here
+* @param unit: the disk unit
+* @param req: the write
+*/
+void cacheStoreWritten(int unit, DiskRequest *req) {
+    if (req->segments == NULL) {
+        cacheStore(unit, req->track * USLOSS_DISK_TRACK_SIZE + req->firstBlock, req->blocks, req->buffer, 0);
+        return;
+    }
+    for (int i = 0; i < req->segmentCount; i++) {
+        cacheStore(unit, req->segments[i].sector, req->segments[i].blocks, req->segments[i].buffer, 0);
+    }
+}
+
+/*
+* Function: cacheFill
+* Adds sectors the driver has just read to the cache, keeping any that are
+* already cached. Called by the driver, so it gives up rather than block:
+* when someone holds cacheLock (they may be waiting on this driver), or when
+* the next block to reuse is dirty and would have to be written first
+* @param unit: the disk unit
+* @param first: the first sector, counted from the start of the disk
+* @param blocks: the number of sectors
+* @param data: the sectors
+* @return the number of sectors added
+*/
+int cacheFill(int unit, int first, int blocks, char *data) {
+    int added = 0;
+    if (MboxCondSend(cacheLock, NULL, 0) != 0) {
+        return 0;
+    }
+    for (int i = 0; i < blocks; i++) {
+        if (cacheLRU->valid && cacheLRU->dirty) {
+            break;
+        }
+        if (cacheLookup(unit, first + i) == NULL) {
+            CacheBlock *block = cacheInsert(unit, first + i);
+            memcpy(block->data, data + i * USLOSS_DISK_SECTOR_SIZE, USLOSS_DISK_SECTOR_SIZE);
+            added++;
+        }
+    }
+    unlock(cacheLock);
+    return added;
+}
+
+/*
+* Function: cacheTouch
+* Moves a block to the front of the LRU list. Must hold cacheLock
+* @param block: the block
+*/
+void cacheTouch(CacheBlock *block) {
+    if (block == cacheMRU) {
+        return;
+    }
+
+    // unlink
+    block->prev->next = block->next;
+    if (block->next != NULL) {
+        block->next->prev = block->prev;
+    }
+    else {
+        cacheLRU = block->prev;
+    }
+
+    block->prev = NULL;
+    block->next = cacheMRU;
+    cacheMRU->prev = block;
+    cacheMRU = block;
+}
+
+/*
+* Function: cacheWriteBack
+* Writes a dirty block to the device and marks it clean. Must hold cacheLock
+* @param block: the block
+*/
+void cacheWriteBack(CacheBlock *block) {
+    diskTransfer(USLOSS_DISK_WRITE, block->unit, block->sector / USLOSS_DISK_TRACK_SIZE,
+                 block->sector % USLOSS_DISK_TRACK_SIZE, 1, block->data);
+    block->dirty = 0;
+    diskCacheStats.writebacks++;
+}
+
+/*
+* Function: cacheFlush
+* Writes back every dirty block. Must hold cacheLock
+*/
+void cacheFlush(void) {
+    for (int unit = 0; unit < USLOSS_DISK_UNITS; unit++) {
+        cacheFlushUnit(unit);
+    }
+}
+
+/*
+* Function: cacheFlushUnit
+* Writes back a unit's dirty blocks as one request, in sector order, so the
+* driver makes a single pass over the disk. Must hold cacheLock
+* @param unit: the disk unit
+*/
+void cacheFlushUnit(int unit) {
+    DiskSegment segments[DISK_CACHE_BLOCKS];
+    CacheBlock *dirty[DISK_CACHE_BLOCKS];
+    int count = 0;
+
+    for (int i = 0; i < DISK_CACHE_BLOCKS; i++) {
+        CacheBlock *block = &cacheBlocks[i];
+        if (!block->valid || !block->dirty || block->unit != unit) {
+            continue;
+        }
+        dirty[count] = block;
+        int j = count++;
+        while (j > 0 && segments[j - 1].sector > block->sector) {
+            segments[j] = segments[j - 1];
+            j--;
+        }
+        segments[j].sector = block->sector;
+        segments[j].blocks = 1;
+        segments[j].buffer = block->data;
+    }
+    if (count == 0) {
+        return;
+    }
+
+    DiskRequest req;
+    req.operation = USLOSS_DISK_WRITE;
+    req.track = segments[0].sector / USLOSS_DISK_TRACK_SIZE;
+    req.firstBlock = segments[0].sector % USLOSS_DISK_TRACK_SIZE;
+    req.blocks = 0;
+    req.buffer = NULL;
+    req.segments = segments;
+    req.segmentCount = count;
+    req.done = NULL;
+    diskSubmit(unit, &req);
+
+    for (int i = 0; i < count; i++) {
+        dirty[i]->dirty = 0;
+    }
+    diskCacheStats.writebacks += count;
+}
+
+/*
+* Function: dumpDiskCacheStats
+* Prints the disk block cache counters, and each unit's seek and write
+* combining counts, to the console
+*/
+void dumpDiskCacheStats(void) {
+    int total = diskCacheStats.hits + diskCacheStats.misses;
+    USLOSS_Console("disk cache: %d blocks, %d hits, %d misses (%d%% hit rate), %d evictions, %d writebacks, "
+                   "%d read ahead\n", DISK_CACHE_BLOCKS, diskCacheStats.hits, diskCacheStats.misses,
+                   total > 0 ? diskCacheStats.hits * 100 / total : 0,
+                   diskCacheStats.evictions, diskCacheStats.writebacks, diskCacheStats.readAheads);
+    for (int i = 0; i < USLOSS_DISK_UNITS; i++) {
+        USLOSS_Console("disk %d: %d seeks, %d writes combined, %d overlapping sectors skipped\n", i,
+                       diskStats[i].seeks, disks[i].combinedWrites, disks[i].skippedSectors);
+    }
+}
+
+/*
+* Function: dumpTermStats
+* Prints how much each terminal has received, dropped and sent
+*/
+void dumpTermStats(void) {
+    for (int i = 0; i < USLOSS_TERM_UNITS; i++) {
+        USLOSS_Console("term %d: %d bytes received, %d bytes dropped (%d lines), %d bytes sent, "
+                       "%d xmit stalls\n", i, termStats[i].received, termStats[i].dropped,
+                       termStats[i].droppedLines, termStats[i].sent, termStats[i].xmitStalls);
+    }
+}
+
+/*
+* Function: dumpDeviceStats
+* Prints every disk and terminal unit's counters, with the disk cache's
+*/
+void dumpDeviceStats(void) {
+    for (int i = 0; i < USLOSS_DISK_UNITS; i++) {
+        DiskStats *stats = &diskStats[i];
+        int requests = stats->reads + stats->writes;
+        USLOSS_Console("disk %d: %d reads (%d sectors), %d writes (%d sectors), %d seeks over %d tracks, "
+                       "queue depth %d (max %d)\n", i, stats->reads, stats->sectorsRead, stats->writes,
+                       stats->sectorsWritten, stats->seeks, stats->seekDistance, stats->queueDepth,
+                       stats->maxQueueDepth);
+        if (requests == 0) {
+            continue;
+        }
+        USLOSS_Console("disk %d: average %d us queued, %d us in service; latency", i,
+                       stats->waitTime / requests, stats->serviceTime / requests);
+        for (int b = 0; b < DISK_LATENCY_BUCKETS; b++) {
+            USLOSS_Console(" %s%dms:%d", b < DISK_LATENCY_BUCKETS - 1 ? "<" : ">=",
+                           b < DISK_LATENCY_BUCKETS - 1 ? 1 << b : 1 << (b - 1), stats->latency[b]);
+        }
+        USLOSS_Console("\n");
+    }
+    dumpDiskCacheStats();
+    dumpTermStats();
+}
+
 // Lock and Unlock functions
 void lock(int lockId) {
     MboxSend(lockId, NULL, 0);
@@ -9,4 +9,183 @@
 
 extern void phase4_init(void);
 
+// What arg1 of SYS_SLEEP is, going by arg2. SLEEP_SECONDS counts the clock
+// ticks phase 2 hands the clock driver, about every 100ms. SLEEP_MS and
+// SLEEP_UNTIL (a time as read by GetTimeofDay) wake on the first clock
+// interrupt, every USLOSS_CLOCK_MS, at or after the time asked for: never
+// early, and at most one interrupt late.
+#define SLEEP_SECONDS           0
+#define SLEEP_MS                1
+#define SLEEP_UNTIL             2
+
+// Terminal output. TermWrite copies its bytes into the unit's transmit ring
+// and returns; the terminal driver sends them one per xmit interrupt. A write
+// longer than the room left waits for the driver to drain the ring. Build
+// with -DTERM_XMIT_RING_SIZE=n to resize the rings.
+#ifndef TERM_XMIT_RING_SIZE
+#define TERM_XMIT_RING_SIZE     256
+#endif
+
+// Terminal input. The driver queues each line it receives on the unit's
+// input ring, which holds up to TERM_RECV_RING_LINES lines and
+// TERM_RECV_RING_BYTES bytes (at least MAXLINE). The device can't be paused,
+// so a line that doesn't fit is dropped under TERM_RECV_BACKPRESSURE, or
+// makes room by dropping the oldest lines under TERM_RECV_OVERWRITE; either
+// way the bytes lost are counted in termStats. TermRead returns one line;
+// TermReadLines returns as many whole queued lines as fit in its buffer.
+#define TERM_RECV_BACKPRESSURE  0
+#define TERM_RECV_OVERWRITE     1
+#ifndef TERM_RECV_RING_LINES
+#define TERM_RECV_RING_LINES    32
+#endif
+#ifndef TERM_RECV_RING_BYTES
+#define TERM_RECV_RING_BYTES    1024
+#endif
+#ifndef TERM_RECV_POLICY
+#define TERM_RECV_POLICY        TERM_RECV_BACKPRESSURE
+#endif
+#define TERM_READ_LINES         1   // flag for SYS_TERMREAD, see TermReadLines
+#if TERM_RECV_RING_BYTES < MAXLINE
+#error "TERM_RECV_RING_BYTES must hold a whole line"
+#endif
+
+typedef struct TermStats {
+    int received;      // bytes received
+    int dropped;       // bytes dropped because the input ring was full
+    int droppedLines;  // lines those bytes were in
+    int sent;          // bytes handed to the transmitter
+    int xmitStalls;    // times a TermWrite waited for room on the transmit ring
+} TermStats;
+
+extern TermStats termStats[USLOSS_TERM_UNITS];
+extern void dumpTermStats(void);
+
+// Disk block cache. Build with -DDISK_CACHE_BLOCKS=n to resize it. With
+// -DDISK_CACHE_WRITEBACK=1 writes stay dirty in the cache until they are
+// evicted or flushed (every DISK_CACHE_FLUSH_SECS seconds); by default they
+// are written through, so DiskWrite still reports the device status.
+#ifndef DISK_CACHE_BLOCKS
+#define DISK_CACHE_BLOCKS       64
+#endif
+#ifndef DISK_CACHE_WRITEBACK
+#define DISK_CACHE_WRITEBACK    0
+#endif
+#ifndef DISK_CACHE_FLUSH_SECS
+#define DISK_CACHE_FLUSH_SECS   1
+#endif
+
+// Write combining. Writes to one track that queue up while the driver is busy
+// are done together in a single pass over the track, and a sector written
+// more than once goes to the device only once. Build with
+// -DDISK_WRITE_COMBINE=0 to service every write on its own. DiskSync(unit)
+// writes back the unit's dirty cache blocks and waits for every request
+// queued on it before the call.
+#ifndef DISK_WRITE_COMBINE
+#define DISK_WRITE_COMBINE      1
+#endif
+
+// Multi-sector transfers. The driver moves each run of consecutive sectors
+// on a track with one USLOSS_DISK_READ_MULTI or USLOSS_DISK_WRITE_MULTI
+// request, and so one interrupt, instead of a request per sector. Build with
+// -DDISK_MULTI_SECTOR=0 to go a sector at a time.
+#ifndef DISK_MULTI_SECTOR
+#define DISK_MULTI_SECTOR       1
+#endif
+
+// Queued disk controller. With -DDISK_DEVICE_QUEUE=N the driver takes up to
+// N requests off the unit's queue at a time, hands all their sectors to the
+// disk as USLOSS_DISK_QUEUE commands and lets the disk choose the order. The
+// disk only holds as many as USLOSS is run with (--disk-queue=N); the driver
+// waits for room when it is full. 0, the default, keeps the driver's own
+// ordering with one request outstanding.
+#ifndef DISK_DEVICE_QUEUE
+#define DISK_DEVICE_QUEUE       0
+#endif
+
+typedef struct DiskCacheStats {
+    int hits;        // sectors read from the cache
+    int misses;      // sectors read from the device
+    int evictions;   // valid blocks reused for another sector
+    int writebacks;  // dirty blocks written to the device
+    int readAheads;  // sectors prefetched by sequential read-ahead
+} DiskCacheStats;
+
+extern DiskCacheStats diskCacheStats;
+extern void dumpDiskCacheStats(void);
+
+// Per-unit device counters. DeviceStats(USLOSS_DISK_DEV, unit, &diskStats)
+// or DeviceStats(USLOSS_TERM_DEV, unit, &termStats) copies a unit's counters
+// (SYS_DEVICESTATS); build the testcases with -DDEVICE_STATS to have them all
+// printed by finish(). Only requests that reach the disk driver are counted,
+// not those the cache answers. latency[i] counts requests that took, from
+// being queued to completing, less than 2^i ms; the last bucket has the rest.
+#define DISK_LATENCY_BUCKETS    12
+
+typedef struct DiskStats {
+    int reads;            // read requests serviced, read-ahead included
+    int writes;           // write requests serviced
+    int sectorsRead;
+    int sectorsWritten;
+    int seeks;            // seek operations issued to the device
+    int seekDistance;     // tracks the head moved over those seeks
+    int queueDepth;       // requests queued or in service now
+    int maxQueueDepth;
+    int waitTime;         // total µs requests spent queued
+    int serviceTime;      // total µs the driver spent on them
+    int latency[DISK_LATENCY_BUCKETS];
+} DiskStats;
+
+extern DiskStats diskStats[USLOSS_DISK_UNITS];
+extern void dumpDeviceStats(void);
+
+// Asynchronous disk I/O (SYS_DISKASYNC). A request returns a ticket at once;
+// when it completes a DiskCompletion is sent to the request's mailbox, if it
+// has one and there is room, and that frees the ticket. Any other ticket must
+// be passed to DiskWait, which returns the request's status and frees it.
+// Tickets a process still holds when it terminates are freed then.
+#define DISK_ASYNC_TICKETS      32
+#define DISK_ASYNC_WAIT         4   // op for SYS_DISKASYNC, after the USLOSS_DISK_* ops
+#define DISK_SET_CLASS          5   // op for SYS_DISKASYNC, see DiskSetClass
+
+typedef struct DiskAsyncRequest {
+    void *buffer;    // must not be touched until the request completes
+    int unit;
+    int track;
+    int first;
+    int sectors;
+    int mbox;        // gets a DiskCompletion, or -1 for none
+} DiskAsyncRequest;
+
+typedef struct DiskCompletion {
+    int ticket;
+    int status;
+} DiskCompletion;
+
+// Scatter-gather disk I/O (SYS_DISKIOV). DiskReadV and DiskWriteV take up to
+// DISK_IOV_MAX entries for one unit, which the kernel sorts by sector and
+// services in a single pass over the disk. Entries of one write must not
+// overlap.
+#define DISK_IOV_MAX            32
+
+typedef struct DiskIoVec {
+    void *buffer;
+    int track;
+    int first;
+    int sectors;
+} DiskIoVec;
+
+// Disk I/O classes. The scheduler serves the highest class queued, in C-SCAN
+// order within it. A process gets its class from the priority Spawn gave it
+// (1 is realtime, 5 is idle, the rest normal) unless it calls DiskSetClass;
+// read-ahead is always idle. Every DISK_AGING_LIMIT requests served ahead of
+// a waiting request move it up one class, so no class starves.
+#define DISK_CLASS_DEFAULT      -1  // back to the class from the priority
+#define DISK_CLASS_REALTIME     0
+#define DISK_CLASS_NORMAL       1
+#define DISK_CLASS_IDLE         2
+
+#ifndef DISK_AGING_LIMIT
+#define DISK_AGING_LIMIT        8
+#endif
+
 #endif /* _PHASE4_H */
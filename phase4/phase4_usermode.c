@@ -8,6 +8,7 @@
 #include <usloss.h>
 #include <usyscall.h>
 
+#include "phase4.h"
 #include "phase4_usermode.h"
 
 #define CHECKMODE { \
@@ -35,6 +36,7 @@ int Sleep(int seconds)
     CHECKMODE;
     sysArg.number = SYS_SLEEP;
     sysArg.arg1 = (void *) ( (long) seconds);
+    sysArg.arg2 = (void *) ( (long) SLEEP_SECONDS);
 
     USLOSS_Syscall(&sysArg);
 
@@ -42,6 +44,56 @@ int Sleep(int seconds)
 } /* end of Sleep */
 
 
+/*
+ *  Routine:  SleepMs
+ *
+ *  Description: Timed delay in milliseconds. Wakes on the first clock
+ *               interrupt after the delay is up.
+ *
+ *  Arguments:    int msecs -- number of milliseconds to sleep
+ *
+ *  Return Value: 0 means success, -1 means error occurs
+ */
+int SleepMs(int msecs)
+{
+    USLOSS_Sysargs sysArg;
+
+    CHECKMODE;
+    sysArg.number = SYS_SLEEP;
+    sysArg.arg1 = (void *) ( (long) msecs);
+    sysArg.arg2 = (void *) ( (long) SLEEP_MS);
+
+    USLOSS_Syscall(&sysArg);
+
+    return (long) sysArg.arg4;
+} /* end of SleepMs */
+
+
+/*
+ *  Routine:  SleepUntil
+ *
+ *  Description: Sleeps until the first clock interrupt at or after a given
+ *               time of day. Returns at once if that time has passed.
+ *
+ *  Arguments:    int usecs -- time to wake, as returned by GetTimeofDay
+ *
+ *  Return Value: 0 means success, -1 means error occurs
+ */
+int SleepUntil(int usecs)
+{
+    USLOSS_Sysargs sysArg;
+
+    CHECKMODE;
+    sysArg.number = SYS_SLEEP;
+    sysArg.arg1 = (void *) ( (long) usecs);
+    sysArg.arg2 = (void *) ( (long) SLEEP_UNTIL);
+
+    USLOSS_Syscall(&sysArg);
+
+    return (long) sysArg.arg4;
+} /* end of SleepUntil */
+
+
 /*
  *  Routine:  TermRead
  *
@@ -64,6 +116,7 @@ int TermRead(char *buffer, int bufferSize, int unitID, int *numCharsRead)
     sysArg.arg1 = (void *) buffer;
     sysArg.arg2 = (void *) ( (long) bufferSize);
     sysArg.arg3 = (void *) ( (long) unitID);
+    sysArg.arg4 = (void *) ( (long) 0);
 
     USLOSS_Syscall(&sysArg);
 
@@ -72,6 +125,40 @@ int TermRead(char *buffer, int bufferSize, int unitID, int *numCharsRead)
 } /* end of TermRead */
 
 
+/*
+ *  Routine:  TermReadLines
+ *
+ *  Description: Like TermRead, but returns every whole line queued on the
+ *               terminal that fits in the buffer, not just the first. The
+ *               result is always null terminated, so at most bufferSize - 1
+ *               characters are read.
+ *
+ *  Arguments:    char *buffer    -- pointer to the input buffer
+ *                int   bufferSize   -- maximum size of the buffer
+ *                int   unitID -- terminal unit number
+ *                int  *numCharsRead      -- pointer to output value
+ *                (output value: number of characters actually read)
+ *
+ *  Return Value: 0 means success, -1 means error occurs
+ */
+int TermReadLines(char *buffer, int bufferSize, int unitID, int *numCharsRead)
+{
+    USLOSS_Sysargs sysArg;
+
+    CHECKMODE;
+    sysArg.number = SYS_TERMREAD;
+    sysArg.arg1 = (void *) buffer;
+    sysArg.arg2 = (void *) ( (long) bufferSize);
+    sysArg.arg3 = (void *) ( (long) unitID);
+    sysArg.arg4 = (void *) ( (long) TERM_READ_LINES);
+
+    USLOSS_Syscall(&sysArg);
+
+    *numCharsRead = (long) sysArg.arg2;
+    return (long) sysArg.arg4;
+} /* end of TermReadLines */
+
+
 /*
  *  Routine:  TermWrite
  *
@@ -201,4 +288,253 @@ int DiskSize(int unit, int *sector, int *track, int *disk)
     return (long) sysArg.arg4;
 } /* end of DiskSize */
 
+/*
+ *  Routine:  diskAsync
+ *
+ *  Description: Common code for DiskReadAsync and DiskWriteAsync.
+ *
+ *  Arguments:    int   operation -- USLOSS_DISK_READ or USLOSS_DISK_WRITE
+ *                the rest as for DiskReadAsync
+ *
+ *  Return Value: 0 means success, -1 means error occurs
+ */
+static int diskAsync(int operation, void *diskBuffer, int unit, int track,
+                     int first, int sectors, int mbox, int *ticket)
+{
+    USLOSS_Sysargs sysArg;
+    DiskAsyncRequest request;
+
+    CHECKMODE;
+    request.buffer  = diskBuffer;
+    request.unit    = unit;
+    request.track   = track;
+    request.first   = first;
+    request.sectors = sectors;
+    request.mbox    = mbox;
+
+    sysArg.number = SYS_DISKASYNC;
+    sysArg.arg1 = (void *) ( (long) operation);
+    sysArg.arg2 = (void *) &request;
+
+    USLOSS_Syscall(&sysArg);
+
+    *ticket = (long) sysArg.arg1;
+    return (long) sysArg.arg4;
+} /* end of diskAsync */
+
+
+/*
+ *  Routine:  DiskReadAsync
+ *
+ *  Description: Starts a disk read and returns without waiting for it.
+ *
+ *  Arguments:    void* diskBuffer  -- pointer to the input buffer
+ *                int   unit -- which disk to read
+ *                int   track  -- first track to read
+ *                int   first -- first sector to read
+ *                int   sectors -- number of sectors to read
+ *                int   mbox -- mailbox to send a DiskCompletion to, or -1
+ *                int  *ticket -- pointer to output value
+ *                (output value: ticket to pass to DiskWait)
+ *
+ *  Return Value: 0 means success, -1 means error occurs
+ */
+int DiskReadAsync(void *diskBuffer, int unit, int track, int first,
+                  int sectors, int mbox, int *ticket)
+{
+    return diskAsync(USLOSS_DISK_READ, diskBuffer, unit, track, first,
+                     sectors, mbox, ticket);
+} /* end of DiskReadAsync */
+
+
+/*
+ *  Routine:  DiskWriteAsync
+ *
+ *  Description: Starts a disk write and returns without waiting for it.
+ *               The buffer must not change until the write completes.
+ *
+ *  Arguments:    as for DiskReadAsync
+ *
+ *  Return Value: 0 means success, -1 means error occurs
+ */
+int DiskWriteAsync(void *diskBuffer, int unit, int track, int first,
+                   int sectors, int mbox, int *ticket)
+{
+    return diskAsync(USLOSS_DISK_WRITE, diskBuffer, unit, track, first,
+                     sectors, mbox, ticket);
+} /* end of DiskWriteAsync */
+
+
+/*
+ *  Routine:  DiskWait
+ *
+ *  Description: Waits for an asynchronous disk request to complete.
+ *
+ *  Arguments:    int   ticket -- from DiskReadAsync or DiskWriteAsync
+ *                int  *status -- pointer to output value
+ *                (output value: completion status)
+ *
+ *  Return Value: 0 means success, -1 means error occurs
+ */
+int DiskWait(int ticket, int *status)
+{
+    USLOSS_Sysargs sysArg;
+
+    CHECKMODE;
+    sysArg.number = SYS_DISKASYNC;
+    sysArg.arg1 = (void *) ( (long) DISK_ASYNC_WAIT);
+    sysArg.arg2 = (void *) ( (long) ticket);
+
+    USLOSS_Syscall(&sysArg);
+
+    *status = (long) sysArg.arg1;
+    return (long) sysArg.arg4;
+} /* end of DiskWait */
+
+
+/*
+ *  Routine:  diskIoV
+ *
+ *  Description: Common code for DiskReadV and DiskWriteV.
+ *
+ *  Arguments:    int   operation -- USLOSS_DISK_READ or USLOSS_DISK_WRITE
+ *                the rest as for DiskReadV
+ *
+ *  Return Value: 0 means success, -1 means error occurs
+ */
+static int diskIoV(int operation, int unit, DiskIoVec *iov, int count,
+                   int *status)
+{
+    USLOSS_Sysargs sysArg;
+
+    CHECKMODE;
+    sysArg.number = SYS_DISKIOV;
+    sysArg.arg1 = (void *) ( (long) operation);
+    sysArg.arg2 = (void *) iov;
+    sysArg.arg3 = (void *) ( (long) count);
+    sysArg.arg4 = (void *) ( (long) unit);
+
+    USLOSS_Syscall(&sysArg);
+
+    *status = (long) sysArg.arg1;
+    return (long) sysArg.arg4;
+} /* end of diskIoV */
+
+
+/*
+ *  Routine:  DiskReadV
+ *
+ *  Description: Reads several runs of sectors from one disk with a
+ *               single request.
+ *
+ *  Arguments:    int   unit -- which disk to read
+ *                DiskIoVec *iov -- the runs: buffer, track, first
+ *                                  sector and number of sectors
+ *                int   count -- number of runs, at most DISK_IOV_MAX
+ *                int  *status -- pointer to output value
+ *                (output value: completion status)
+ *
+ *  Return Value: 0 means success, -1 means error occurs
+ */
+int DiskReadV(int unit, DiskIoVec *iov, int count, int *status)
+{
+    return diskIoV(USLOSS_DISK_READ, unit, iov, count, status);
+} /* end of DiskReadV */
+
+
+/*
+ *  Routine:  DiskWriteV
+ *
+ *  Description: Writes several runs of sectors to one disk with a
+ *               single request. The runs must not overlap.
+ *
+ *  Arguments:    as for DiskReadV
+ *
+ *  Return Value: 0 means success, -1 means error occurs
+ */
+int DiskWriteV(int unit, DiskIoVec *iov, int count, int *status)
+{
+    return diskIoV(USLOSS_DISK_WRITE, unit, iov, count, status);
+} /* end of DiskWriteV */
+
+
+/*
+ *  Routine:  DiskSync
+ *
+ *  Description: Waits until everything written to a disk so far,
+ *               including asynchronous and cached writes, is on the disk.
+ *
+ *  Arguments:    int   unit -- which disk to sync
+ *
+ *  Return Value: 0 means success, -1 means error occurs
+ */
+int DiskSync(int unit)
+{
+    USLOSS_Sysargs sysArg;
+
+    CHECKMODE;
+    sysArg.number = SYS_DISKSYNC;
+    sysArg.arg1 = (void *) ( (long) unit);
+
+    USLOSS_Syscall(&sysArg);
+
+    return (long) sysArg.arg4;
+} /* end of DiskSync */
+
+
+/*
+ *  Routine:  DiskSetClass
+ *
+ *  Description: Sets the I/O class of the calling process's disk
+ *               requests.
+ *
+ *  Arguments:    int   ioClass -- DISK_CLASS_REALTIME, DISK_CLASS_NORMAL,
+ *                                 DISK_CLASS_IDLE, or DISK_CLASS_DEFAULT
+ *                                 for the class that goes with the
+ *                                 process's priority
+ *
+ *  Return Value: 0 means success, -1 means error occurs
+ */
+int DiskSetClass(int ioClass)
+{
+    USLOSS_Sysargs sysArg;
+
+    CHECKMODE;
+    sysArg.number = SYS_DISKASYNC;
+    sysArg.arg1 = (void *) ( (long) DISK_SET_CLASS);
+    sysArg.arg2 = (void *) ( (long) ioClass);
+
+    USLOSS_Syscall(&sysArg);
+
+    return (long) sysArg.arg4;
+} /* end of DiskSetClass */
+
+
+/*
+ *  Routine:  DeviceStats
+ *
+ *  Description: Copies the I/O counters of a disk or terminal unit.
+ *
+ *  Arguments:    int   type  -- USLOSS_DISK_DEV or USLOSS_TERM_DEV
+ *                int   unit  -- which unit
+ *                void *stats -- a DiskStats for a disk, a TermStats
+ *                               for a terminal
+ *
+ *  Return Value: 0 means success, -1 means error occurs
+ */
+int DeviceStats(int type, int unit, void *stats)
+{
+    USLOSS_Sysargs sysArg;
+
+    CHECKMODE;
+    sysArg.number = SYS_DEVICESTATS;
+    sysArg.arg1 = (void *) ( (long) type);
+    sysArg.arg2 = (void *) ( (long) unit);
+    sysArg.arg3 = stats;
+
+    USLOSS_Syscall(&sysArg);
+
+    return (long) sysArg.arg4;
+} /* end of DeviceStats */
+
 /* end libuser.c */
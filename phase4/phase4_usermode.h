@@ -10,14 +10,29 @@
  */
 
 extern  int  Sleep(int seconds);
+extern  int  SleepMs(int msecs);
+extern  int  SleepUntil(int usecs);
 
 extern  int  DiskRead (void *diskBuffer, int unit, int track, int first, 
                        int sectors, int *status);
 extern  int  DiskWrite(void *diskBuffer, int unit, int track, int first,
                        int sectors, int *status);
 extern  int  DiskSize (int unit, int *sector, int *track, int *disk);
+extern  int  DiskReadAsync (void *diskBuffer, int unit, int track, int first,
+                            int sectors, int mbox, int *ticket);
+extern  int  DiskWriteAsync(void *diskBuffer, int unit, int track, int first,
+                            int sectors, int mbox, int *ticket);
+extern  int  DiskWait(int ticket, int *status);
+struct DiskIoVec;    /* in phase4.h */
+extern  int  DiskReadV (int unit, struct DiskIoVec *iov, int count, int *status);
+extern  int  DiskWriteV(int unit, struct DiskIoVec *iov, int count, int *status);
+extern  int  DiskSync (int unit);
+extern  int  DiskSetClass(int ioClass);
+extern  int  DeviceStats(int type, int unit, void *stats);
 extern  int  TermRead (char *buffer, int bufferSize, int unitID,
                        int *numCharsRead);
+extern  int  TermReadLines(char *buffer, int bufferSize, int unitID,
+                           int *numCharsRead);
 extern  int  TermWrite(char *buffer, int bufferSize, int unitID,
                        int *numCharsRead);
 
@@ -119,6 +119,10 @@ void phase5_start_service_processes()
 void finish(int argc, char **argv)
 {
     USLOSS_Console("%s(): The simulation is now terminating.\n", __func__);
+#ifdef DEVICE_STATS
+    // build with -DDEVICE_STATS to get the disk and terminal counters at exit
+    dumpDeviceStats();
+#endif
 }
 
 void test_setup  (int argc, char **argv) {}
@@ -0,0 +1,51 @@
+/* DISKTEST
+ * Asynchronous disk I/O: start a write on each disk from one process, collect
+ * both with DiskWait, then read the sectors back asynchronously.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <phase4.h>
+#include <phase4_usermode.h>
+
+static char writeBuf[2][512];
+static char readBuf[2][512];
+
+int start4(void *arg)
+{
+    int unit, result, status;
+    int ticket[2];
+
+    USLOSS_Console("start4(): started\n");
+
+    for (unit = 0; unit < 2; unit++) {
+        sprintf(writeBuf[unit], "async sector for disk %d", unit);
+        result = DiskWriteAsync(writeBuf[unit], unit, 3, 5, 1, -1, &ticket[unit]);
+        USLOSS_Console("start4(): DiskWriteAsync on disk %d returned %d\n", unit, result);
+    }
+    for (unit = 0; unit < 2; unit++) {
+        result = DiskWait(ticket[unit], &status);
+        USLOSS_Console("start4(): DiskWait on disk %d returned %d, status %d\n", unit, result, status);
+    }
+    result = DiskWait(ticket[0], &status);
+    USLOSS_Console("start4(): DiskWait on a finished ticket returned %d\n", result);
+
+    for (unit = 0; unit < 2; unit++) {
+        DiskReadAsync(readBuf[unit], unit, 3, 5, 1, -1, &ticket[unit]);
+    }
+    for (unit = 0; unit < 2; unit++) {
+        DiskWait(ticket[unit], &status);
+        USLOSS_Console("start4(): read back from disk %d: %s\n", unit, readBuf[unit]);
+    }
+
+    result = DiskReadAsync(readBuf[0], 2, 0, 0, 1, -1, &ticket[0]);
+    USLOSS_Console("start4(): DiskReadAsync on disk 2 returned %d\n", result);
+
+    Terminate(0);
+}
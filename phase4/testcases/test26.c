@@ -0,0 +1,85 @@
+/* DISKTEST
+ * Scatter-gather disk I/O: write runs on several tracks of disk 1 with one
+ * DiskWriteV, push them out of the block cache, then read them back with one
+ * DiskReadV whose runs are split differently from the write.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <phase4.h>
+#include <phase4_usermode.h>
+
+static char writeBuf[4][3 * 512];
+static char readBuf[5][3 * 512];
+static char fillBuf[16 * 512];
+
+int start4(void *arg)
+{
+    DiskIoVec iov[5];
+    int result, status, i;
+
+    USLOSS_Console("start4(): started\n");
+
+    // Out of order on purpose; runs 1 and 2 are back to back on track 2
+    int tracks[4] = { 7, 2, 2, 5 };
+    int firsts[4] = { 0, 4, 7, 14 };
+    int counts[4] = { 1, 3, 2, 3 };
+    for (i = 0; i < 4; i++) {
+        for (int s = 0; s < counts[i]; s++) {
+            sprintf(writeBuf[i] + s * 512, "run %d sector %d", i, s);
+        }
+        iov[i].buffer = writeBuf[i];
+        iov[i].track = tracks[i];
+        iov[i].first = firsts[i];
+        iov[i].sectors = counts[i];
+    }
+    result = DiskWriteV(1, iov, 4, &status);
+    USLOSS_Console("start4(): DiskWriteV returned %d, status %d\n", result, status);
+
+    // Read enough of disk 0 to evict every cached block
+    for (i = 0; i < 6; i++) {
+        DiskRead(fillBuf, 0, i, 0, 16, &status);
+    }
+
+    // Run 3 wraps from track 5 onto track 6; read it as two runs
+    int rtracks[5] = { 6, 2, 7, 5, 2 };
+    int rfirsts[5] = { 0, 4, 0, 14, 6 };
+    int rcounts[5] = { 1, 2, 1, 2, 3 };
+    for (i = 0; i < 5; i++) {
+        memset(readBuf[i], 0, sizeof(readBuf[i]));
+        iov[i].buffer = readBuf[i];
+        iov[i].track = rtracks[i];
+        iov[i].first = rfirsts[i];
+        iov[i].sectors = rcounts[i];
+    }
+    result = DiskReadV(1, iov, 5, &status);
+    USLOSS_Console("start4(): DiskReadV returned %d, status %d\n", result, status);
+    for (i = 0; i < 5; i++) {
+        for (int s = 0; s < rcounts[i]; s++) {
+            USLOSS_Console("start4(): track %d sector %2d: %s\n", rtracks[i],
+                           rfirsts[i] + s, readBuf[i] + s * 512);
+        }
+    }
+
+    result = DiskReadV(1, iov, 0, &status);
+    USLOSS_Console("start4(): DiskReadV with no runs returned %d\n", result);
+
+    iov[0].buffer = writeBuf[0];
+    iov[0].track = 3;
+    iov[0].first = 0;
+    iov[0].sectors = 2;
+    iov[1].buffer = writeBuf[1];
+    iov[1].track = 3;
+    iov[1].first = 1;
+    iov[1].sectors = 1;
+    result = DiskWriteV(1, iov, 2, &status);
+    USLOSS_Console("start4(): DiskWriteV with overlapping runs returned %d\n", result);
+
+    Terminate(0);
+}
@@ -0,0 +1,60 @@
+/* DISKTEST
+ * Write combining and DiskSync: start overlapping asynchronous writes to one
+ * track, sync the disk, push the track out of the block cache and read it
+ * back. Where writes overlap, the one started last must win.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <phase4.h>
+#include <phase4_usermode.h>
+
+static char writeBuf[4][2 * 512];
+static char readBuf[4 * 512];
+static char fillBuf[16 * 512];
+
+int start4(void *arg)
+{
+    int result, status, i;
+    int ticket[4];
+
+    USLOSS_Console("start4(): started\n");
+
+    // sectors 0-1, 1-2, 3 and 0 of track 4
+    int firsts[4] = { 0, 1, 3, 0 };
+    int counts[4] = { 2, 2, 1, 1 };
+    for (i = 0; i < 4; i++) {
+        for (int s = 0; s < counts[i]; s++) {
+            sprintf(writeBuf[i] + s * 512, "write %d", i);
+        }
+        DiskWriteAsync(writeBuf[i], 0, 4, firsts[i], counts[i], -1, &ticket[i]);
+    }
+
+    result = DiskSync(0);
+    USLOSS_Console("start4(): DiskSync returned %d\n", result);
+    for (i = 0; i < 4; i++) {
+        DiskWait(ticket[i], &status);
+        USLOSS_Console("start4(): write %d finished with status %d\n", i, status);
+    }
+
+    // Read enough of disk 1 to evict every cached block
+    for (i = 0; i < 6; i++) {
+        DiskRead(fillBuf, 1, i, 0, 16, &status);
+    }
+
+    DiskRead(readBuf, 0, 4, 0, 4, &status);
+    for (i = 0; i < 4; i++) {
+        USLOSS_Console("start4(): track 4 sector %d: %s\n", i, readBuf + i * 512);
+    }
+
+    result = DiskSync(2);
+    USLOSS_Console("start4(): DiskSync on disk 2 returned %d\n", result);
+
+    Terminate(0);
+}
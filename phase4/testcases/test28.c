@@ -0,0 +1,63 @@
+/* DISKTEST
+ * Disk I/O classes: three bulk writers spawned at priority 5 (idle class)
+ * keep disk 1 busy while a reader at priority 4 (normal class) reads from
+ * it. Each of the reader's requests should be served as soon as the
+ * request in progress finishes, and the writers should still finish.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <phase4.h>
+#include <phase4_usermode.h>
+
+static char writeBuf[3][512];
+
+int Writer(void *arg)
+{
+    int id = (int)(long)arg;
+    int status;
+
+    for (int i = 0; i < 4; i++) {
+        int track = 2 + id * 4 + i;
+        sprintf(writeBuf[id], "writer %d track %d", id, track);
+        DiskWrite(writeBuf[id], 1, track, 0, 1, &status);
+        USLOSS_Console("Writer%d(): wrote track %d\n", id, track);
+    }
+    Terminate(id);
+}
+
+int Reader(void *arg)
+{
+    char buf[512];
+    int status;
+
+    for (int i = 0; i < 3; i++) {
+        int track = 15 - i * 7;
+        DiskRead(buf, 1, track, 8, 1, &status);
+        USLOSS_Console("Reader(): read track %d, status %d\n", track, status);
+    }
+    Terminate(9);
+}
+
+int start4(void *arg)
+{
+    int pid, status;
+
+    USLOSS_Console("start4(): DiskSetClass(7) returned %d\n", DiskSetClass(7));
+
+    Spawn("Reader", Reader, NULL, USLOSS_MIN_STACK, 4, &pid);
+    for (int i = 0; i < 3; i++) {
+        Spawn("Writer", Writer, (void *)(long)i, USLOSS_MIN_STACK, 5, &pid);
+    }
+    for (int i = 0; i < 4; i++) {
+        Wait(&pid, &status);
+        USLOSS_Console("start4(): process %d quit with status %d\n", pid, status);
+    }
+    Terminate(0);
+}
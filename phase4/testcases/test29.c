@@ -0,0 +1,56 @@
+/* TERMTEST
+ * Buffered terminal output: three children write a line each to terminal 3
+ * at the same time. The first line is longer than the transmit ring, so its
+ * writer has to wait for room; the other two only queue theirs and return.
+ * Each line must still come out in one piece, and all of it before the
+ * writers are gone.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <phase4.h>
+#include <phase4_usermode.h>
+
+int Writer(void *arg)
+{
+    int id = (int)(long)arg;
+    int length = (id == 0) ? TERM_XMIT_RING_SIZE + 20 : 20;
+    char buf[TERM_XMIT_RING_SIZE + 20];
+    int result, size;
+
+    memset(buf, 'a' + id, length - 1);
+    buf[length - 1] = '\n';
+
+    result = TermWrite(buf, length, 3, &size);
+    USLOSS_Console("Writer%d(): TermWrite returned %d, wrote %d of %d characters\n",
+                   id, result, size, length);
+    Terminate(id);
+}
+
+extern int testcase_timeout;   // defined in the testcase common code
+
+int start4(void *arg)
+{
+    int pid, status;
+
+    testcase_timeout = 60;
+
+    USLOSS_Console("start4(): Spawn three writers to terminal 3.\n");
+
+    for (int i = 0; i < 3; i++) {
+        Spawn("Writer", Writer, (void *)(long)i, USLOSS_MIN_STACK, 3, &pid);
+    }
+    for (int i = 0; i < 3; i++) {
+        Wait(&pid, &status);
+        USLOSS_Console("start4(): process %d quit with status %d\n", pid, status);
+    }
+
+    USLOSS_Console("start4(): done.\n");
+    Terminate(0);
+}
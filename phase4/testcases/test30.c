@@ -0,0 +1,49 @@
+/* TERMTEST
+ * Terminal input buffering: sleep until all twelve lines of term2.in have
+ * come in, more than the ten the driver used to hold, then take them with
+ * TermReadLines. Every line should be there, several per call.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <phase4.h>
+#include <phase4_usermode.h>
+
+extern int testcase_timeout;   // defined in the testcase common code
+
+int start4(void *arg)
+{
+    char buf[200];
+    int lines = 0, calls = 0, length, result;
+
+    testcase_timeout = 60;
+
+    USLOSS_Console("start4(): Sleep while terminal 2 fills up.\n");
+    Sleep(30);
+
+    while (lines < 12) {
+        result = TermReadLines(buf, sizeof(buf) - 1, 2, &length);
+        if (result < 0) {
+            USLOSS_Console("start4(): ERROR from TermReadLines, result = %d\n", result);
+            Terminate(1);
+        }
+        calls++;
+
+        int count = 0;
+        for (int i = 0; i < length; i++) {
+            count += (buf[i] == '\n');
+        }
+        lines += count;
+        USLOSS_Console("start4(): TermReadLines returned %d lines, %d characters:\n%s", count, length, buf);
+    }
+
+    USLOSS_Console("start4(): read %d lines in %d calls, %d bytes dropped.\n",
+                   lines, calls, termStats[2].dropped);
+    Terminate(0);
+}
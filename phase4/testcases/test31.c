@@ -0,0 +1,56 @@
+/* SLEEPTEST
+ * Timer wheel: ten children sleep for ten different times, spawned out of
+ * order. The longer sleeps are more than one turn of the wheel's first level
+ * away, so they have to move down a level before they fire. The children
+ * should wake shortest sleep first, each after at least its sleep time.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <phase4.h>
+#include <phase4_usermode.h>
+
+int Child(void *arg)
+{
+    int seconds = atoi(arg);
+    int begin, end;
+
+    GetTimeofDay(&begin);
+    Sleep(seconds);
+    GetTimeofDay(&end);
+
+    if (end - begin < seconds * 1000 * 1000) {
+        USLOSS_Console("Child(%d): woke too early, after %d us\n", seconds, end - begin);
+    }
+    else {
+        USLOSS_Console("Child(%d): woke\n", seconds);
+    }
+    Terminate(seconds);
+}
+
+extern int testcase_timeout;   // defined in the testcase common code
+
+int start4(void *arg)
+{
+    char *seconds[] = { "7", "0", "12", "3", "9", "1", "15", "5", "2", "8" };
+    int pid, status;
+
+    testcase_timeout = 30;
+
+    USLOSS_Console("start4(): Spawn ten children that sleep for different times.\n");
+    for (int i = 0; i < 10; i++) {
+        Spawn("Child", Child, seconds[i], USLOSS_MIN_STACK, 4, &pid);
+    }
+    for (int i = 0; i < 10; i++) {
+        Wait(&pid, &status);
+    }
+
+    USLOSS_Console("start4(): done.\n");
+    Terminate(0);
+}
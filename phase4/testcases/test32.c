@@ -0,0 +1,67 @@
+/* SLEEPTEST
+ * Millisecond sleeps: SleepMs and SleepUntil for delays shorter than the
+ * 100ms that Sleep counts in. Each should last at least as long as asked,
+ * and end within a clock tick (USLOSS_CLOCK_MS) or so of that. A time that
+ * has passed returns at once, and a negative delay is an error.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <phase4.h>
+#include <phase4_usermode.h>
+
+// a little slack on top of the tick for the syscall and the context switch
+#define LATE_US (USLOSS_CLOCK_MS * 1000 + 5000)
+
+static void check(char *what, int asked, int begin, int end)
+{
+    int slept = end - begin;
+
+    if (slept < asked) {
+        USLOSS_Console("start4(): %s woke early: %d us of %d\n", what, slept, asked);
+    }
+    else if (slept > asked + LATE_US) {
+        USLOSS_Console("start4(): %s woke late: %d us of %d\n", what, slept, asked);
+    }
+    else {
+        USLOSS_Console("start4(): %s ok\n", what);
+    }
+}
+
+int start4(void *arg)
+{
+    int ms[] = { 5, 20, 35, 50, 1 };
+    int begin, end, result;
+    char what[32];
+
+    for (int i = 0; i < 5; i++) {
+        GetTimeofDay(&begin);
+        result = SleepMs(ms[i]);
+        GetTimeofDay(&end);
+        sprintf(what, "SleepMs(%d) = %d", ms[i], result);
+        check(what, ms[i] * 1000, begin, end);
+    }
+
+    // a row of deadlines 30ms apart shouldn't drift
+    GetTimeofDay(&begin);
+    for (int i = 1; i <= 10; i++) {
+        result = SleepUntil(begin + i * 30000);
+        GetTimeofDay(&end);
+        sprintf(what, "SleepUntil(+%dms) = %d", i * 30, result);
+        check(what, i * 30000, begin, end);
+    }
+
+    GetTimeofDay(&begin);
+    result = SleepUntil(begin - 1000);
+    GetTimeofDay(&end);
+    USLOSS_Console("start4(): SleepUntil(the past) = %d, %s\n", result,
+                   end - begin < USLOSS_CLOCK_MS * 1000 ? "at once" : "after sleeping");
+
+    USLOSS_Console("start4(): SleepMs(-1) = %d\n", SleepMs(-1));
+    Terminate(0);
+}
@@ -0,0 +1,63 @@
+/* DISKTEST
+ * Device statistics: a few disk requests on unit 1 and a line written to
+ * terminal 1 show up in the counters DeviceStats returns. A bad type or
+ * unit is rejected.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <phase4.h>
+#include <phase4_usermode.h>
+
+int Writer(void *arg)
+{
+    int count;
+
+    TermWrite("device stats\n", 13, 1, &count);
+    Terminate(1);
+}
+
+int start4(void *arg)
+{
+    char buf[2 * 512];
+    DiskStats disk;
+    TermStats term;
+    int pid, status;
+
+    USLOSS_Console("start4(): DeviceStats(bad type) returned %d\n", DeviceStats(7, 0, &disk));
+    USLOSS_Console("start4(): DeviceStats(bad disk) returned %d\n", DeviceStats(USLOSS_DISK_DEV, 2, &disk));
+    USLOSS_Console("start4(): DeviceStats(bad term) returned %d\n", DeviceStats(USLOSS_TERM_DEV, 4, &term));
+
+    memset(buf, 'x', sizeof(buf));
+    DiskWrite(buf, 1, 3, 0, 2, &status);
+    DiskWrite(buf, 1, 10, 5, 1, &status);
+    DiskRead(buf, 1, 12, 0, 1, &status);
+
+    DeviceStats(USLOSS_DISK_DEV, 1, &disk);
+    int total = 0;
+    for (int i = 0; i < DISK_LATENCY_BUCKETS; i++) {
+        total += disk.latency[i];
+    }
+    USLOSS_Console("start4(): disk 1: %d reads (%d sectors), %d writes (%d sectors)\n",
+                   disk.reads, disk.sectorsRead, disk.writes, disk.sectorsWritten);
+    USLOSS_Console("start4(): disk 1: %d seeks over %d tracks, queue depth %d, max %d\n",
+                   disk.seeks, disk.seekDistance, disk.queueDepth, disk.maxQueueDepth);
+    USLOSS_Console("start4(): disk 1: %d requests in the latency histogram, service time %s\n",
+                   total, disk.serviceTime > 0 ? "counted" : "missing");
+
+    DeviceStats(USLOSS_DISK_DEV, 0, &disk);
+    USLOSS_Console("start4(): disk 0: %d reads, %d writes\n", disk.reads, disk.writes);
+
+    Spawn("Writer", Writer, NULL, USLOSS_MIN_STACK, 2, &pid);
+    Wait(&pid, &status);
+    DeviceStats(USLOSS_TERM_DEV, 1, &term);
+    USLOSS_Console("start4(): term 1: %d bytes sent, %d xmit stalls\n", term.sent, term.xmitStalls);
+
+    Terminate(0);
+}
@@ -0,0 +1,48 @@
+/* DISKTEST
+ * Multi-sector transfers: a 20-sector write that starts part way through
+ * track 2 and runs into track 3 is read back from the device, after other
+ * writes have pushed it out of the block cache, and matches.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <phase4.h>
+#include <phase4_usermode.h>
+
+static char data[20 * 512];
+static char back[20 * 512];
+static char filler[16 * 512];
+
+int start4(void *arg)
+{
+    DiskStats before, after;
+    int status;
+
+    for (int i = 0; i < 20; i++) {
+        memset(data + i * 512, 'a' + i, 512);
+        sprintf(data + i * 512, "sector %d", i);
+    }
+    DiskWrite(data, 1, 2, 10, 20, &status);
+    USLOSS_Console("start4(): wrote 20 sectors from track 2 sector 10, status %d\n", status);
+
+    // Evict them from the cache
+    memset(filler, 'z', sizeof(filler));
+    for (int track = 8; track < 8 + DISK_CACHE_BLOCKS / 16; track++) {
+        DiskWrite(filler, 1, track, 0, 16, &status);
+    }
+
+    DeviceStats(USLOSS_DISK_DEV, 1, &before);
+    DiskRead(back, 1, 2, 10, 20, &status);
+    DeviceStats(USLOSS_DISK_DEV, 1, &after);
+    USLOSS_Console("start4(): read them back, status %d, %d sectors from the device\n", status,
+                   after.sectorsRead - before.sectorsRead);
+    USLOSS_Console("start4(): the data %s\n", memcmp(data, back, sizeof(data)) == 0 ? "matches" : "differs");
+
+    Terminate(0);
+}
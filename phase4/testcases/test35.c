@@ -0,0 +1,66 @@
+/* DISKTEST
+ * A batch of scattered asynchronous writes, some of them crossing tracks,
+ * is synced, pushed out of the block cache and read back asynchronously in
+ * the other order. Every request must finish and every sector must land
+ * where it was written, whatever order the disk chose; run it with
+ * -DDISK_DEVICE_QUEUE=8 and --disk-queue=8 to exercise the queued
+ * controller.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <phase4.h>
+#include <phase4_usermode.h>
+
+#define WRITES 6
+
+static int tracks[WRITES]  = { 13, 2, 9, 5, 0, 11 };
+static int firsts[WRITES]  = { 0, 12, 4, 8, 3, 14 };
+static int counts[WRITES]  = { 16, 8, 3, 16, 1, 4 };
+
+static char writeBuf[WRITES][16 * 512];
+static char readBuf[WRITES][16 * 512];
+static char fillBuf[16 * 512];
+
+int start4(void *arg)
+{
+    int ticket[WRITES];
+    int status, i;
+
+    USLOSS_Console("start4(): started\n");
+
+    for (i = 0; i < WRITES; i++) {
+        for (int s = 0; s < counts[i]; s++) {
+            memset(writeBuf[i] + s * 512, 'A' + i, 512);
+            sprintf(writeBuf[i] + s * 512, "write %d sector %d", i, s);
+        }
+        DiskWriteAsync(writeBuf[i], 0, tracks[i], firsts[i], counts[i], -1, &ticket[i]);
+    }
+    DiskSync(0);
+    for (i = 0; i < WRITES; i++) {
+        DiskWait(ticket[i], &status);
+        USLOSS_Console("start4(): write %d to track %d finished with status %d\n", i, tracks[i], status);
+    }
+
+    // Read enough of disk 1 to evict every cached block
+    for (i = 0; i < DISK_CACHE_BLOCKS / 16; i++) {
+        DiskRead(fillBuf, 1, i, 0, 16, &status);
+    }
+
+    for (i = WRITES - 1; i >= 0; i--) {
+        DiskReadAsync(readBuf[i], 0, tracks[i], firsts[i], counts[i], -1, &ticket[i]);
+    }
+    for (i = WRITES - 1; i >= 0; i--) {
+        DiskWait(ticket[i], &status);
+        USLOSS_Console("start4(): read %d from track %d finished with status %d, the data %s\n", i, tracks[i],
+                       status, memcmp(writeBuf[i], readBuf[i], counts[i] * 512) == 0 ? "matches" : "differs");
+    }
+
+    Terminate(0);
+}
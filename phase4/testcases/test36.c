@@ -0,0 +1,63 @@
+/* TERMTEST
+ * Reads that exactly fill the buffer: a TermRead the size of the first line
+ * of term2.in, then TermReadLines calls whose lines would fill the buffer
+ * exactly, leaving no room for the terminating null. The byte just past the
+ * buffer must never be written.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <phase4.h>
+#include <phase4_usermode.h>
+
+extern int testcase_timeout;   // defined in the testcase common code
+
+char buf[200];
+
+void readLines(int size)
+{
+    int length, result;
+
+    memset(buf, '#', sizeof(buf));
+    result = TermReadLines(buf, size, 2, &length);
+    if (result < 0) {
+        USLOSS_Console("start4(): ERROR from TermReadLines, result = %d\n", result);
+        Terminate(1);
+    }
+    USLOSS_Console("start4(): TermReadLines(%d) read %d characters, terminated %s, guard byte %s:\n%s",
+                   size, length, buf[length] == '\0' ? "yes" : "no",
+                   buf[size] == '#' ? "intact" : "OVERWRITTEN", buf);
+}
+
+int start4(void *arg)
+{
+    int length, result;
+
+    testcase_timeout = 60;
+
+    USLOSS_Console("start4(): Sleep while terminal 2 fills up.\n");
+    Sleep(30);
+
+    // the first line is 50 characters, newline included
+    memset(buf, '#', sizeof(buf));
+    result = TermRead(buf, 50, 2, &length);
+    if (result < 0) {
+        USLOSS_Console("start4(): ERROR from TermRead, result = %d\n", result);
+        Terminate(1);
+    }
+    USLOSS_Console("start4(): TermRead(50) read %d characters, guard byte %s\n",
+                   length, buf[50] == '#' ? "intact" : "OVERWRITTEN");
+
+    // lines 2-3 are 60 characters and lines 3-5 are 138, so each of these
+    // would fill its buffer exactly and must stop one line short
+    readLines(60);
+    readLines(138);
+
+    Terminate(0);
+}
@@ -0,0 +1,107 @@
+/*
+ * Asynchronous disk tickets are not leaked: children that quit without
+ * calling DiskWait take every ticket, and 40 requests whose completions go to
+ * a mailbox are never waited for, yet later requests still get a ticket. User
+ * mode can't use mailboxes in phase 4, so the test installs kernel handlers
+ * for the mailbox syscalls of later phases.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <phase4.h>
+#include <phase4_usermode.h>
+
+char writeBuf[USLOSS_DISK_SECTOR_SIZE];
+
+void mboxCreateSys(USLOSS_Sysargs *args)
+{
+    args->arg1 = (void *)(long)MboxCreate((int)(long)args->arg1, (int)(long)args->arg2);
+}
+
+void mboxRecvSys(USLOSS_Sysargs *args)
+{
+    args->arg2 = (void *)(long)MboxRecv((int)(long)args->arg1, args->arg2, (int)(long)args->arg3);
+}
+
+int userMboxCreate(int slots, int size)
+{
+    USLOSS_Sysargs args;
+
+    args.number = SYS_MBOXCREATE;
+    args.arg1 = (void *)(long)slots;
+    args.arg2 = (void *)(long)size;
+    USLOSS_Syscall(&args);
+    return (int)(long)args.arg1;
+}
+
+int userMboxRecv(int mbox, void *msg, int size)
+{
+    USLOSS_Sysargs args;
+
+    args.number = SYS_MBOXRECEIVE;
+    args.arg1 = (void *)(long)mbox;
+    args.arg2 = msg;
+    args.arg3 = (void *)(long)size;
+    USLOSS_Syscall(&args);
+    return (int)(long)args.arg2;
+}
+
+int Quitter(void *arg)
+{
+    int i, ticket;
+
+    // start some writes and terminate without waiting for any of them
+    for (i = 0; i < 4; i++) {
+        if (DiskWriteAsync(writeBuf, 1, 2, i, 1, -1, &ticket) < 0) {
+            USLOSS_Console("Quitter(): ERROR: DiskWriteAsync %d failed\n", i);
+        }
+    }
+    Terminate(0);
+}
+
+int start4(void *arg)
+{
+    DiskCompletion completion;
+    int i, pid, status, ticket, result, mbox, received = 0;
+
+    memset(writeBuf, 'q', sizeof(writeBuf));
+    systemCallVec[SYS_MBOXCREATE] = mboxCreateSys;
+    systemCallVec[SYS_MBOXRECEIVE] = mboxRecvSys;
+
+    USLOSS_Console("start4(): 8 children each start 4 writes and quit without waiting\n");
+    for (i = 0; i < 8; i++) {
+        Spawn("Quitter", Quitter, NULL, USLOSS_MIN_STACK, 2, &pid);
+        Wait(&pid, &status);
+    }
+    Sleep(1);  // their writes finish, and that frees their tickets
+
+    USLOSS_Console("start4(): 40 writes that report to a mailbox, never waited for\n");
+    mbox = userMboxCreate(1, sizeof(DiskCompletion));
+    for (i = 0; i < 40; i++) {
+        result = DiskWriteAsync(writeBuf, 1, 3, i % USLOSS_DISK_TRACK_SIZE, 1, mbox, &ticket);
+        if (result < 0) {
+            USLOSS_Console("start4(): ERROR: DiskWriteAsync %d failed\n", i);
+            break;
+        }
+        userMboxRecv(mbox, &completion, sizeof(completion));
+        if (completion.ticket == ticket && completion.status == USLOSS_DEV_READY) {
+            received++;
+        }
+    }
+    USLOSS_Console("start4(): %d completions received\n", received);
+    result = DiskWait(ticket, &status);
+    USLOSS_Console("start4(): DiskWait on a delivered ticket returned %d\n", result);
+
+    result = DiskWriteAsync(writeBuf, 1, 4, 0, 1, -1, &ticket);
+    USLOSS_Console("start4(): DiskWriteAsync afterwards returned %d\n", result);
+    result = DiskWait(ticket, &status);
+    USLOSS_Console("start4(): DiskWait returned %d, status %d\n", result, status);
+
+    Terminate(0);
+}
@@ -0,0 +1,89 @@
+/* SLEEPTEST
+ * Timer wheel boundaries: timers armed more than a turn of the first level
+ * away wait on the level above, and move down when the first level comes
+ * round. One due on exactly that tick must still fire on it, not the tick
+ * after.
+ *
+ * start4 sleeps with SleepUntil to deadlines that land on clock interrupts 64
+ * and 128, each armed a full turn or more ahead. The clock interrupts every
+ * USLOSS_CLOCK_MS, the first half a period after boot, so each deadline is
+ * put a quarter of a period before its interrupt; it should wake less than a
+ * period after the deadline.
+ *
+ * Sleep's wheel is at tick 0 when start4 runs. Two children take single
+ * ticks of it with Sleep(0), then Sleep(12). Early's lands on tick 128,
+ * Late's on tick 129, so Early should wake a tick before Late.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <phase4.h>
+#include <phase4_usermode.h>
+
+#define PERIOD_US (USLOSS_CLOCK_MS * 1000)
+
+// a quarter of a period before the given clock interrupt
+#define JUST_BEFORE(tick) ((tick) * PERIOD_US - PERIOD_US * 3 / 4)
+
+int woke[2];
+
+extern int testcase_timeout;   // defined in the testcase common code
+
+int Sleeper(void *arg)
+{
+    int late = (arg != NULL);
+
+    for (int i = 0; i < 8 + late; i++) {
+        Sleep(0);
+    }
+    Sleep(12);
+    GetTimeofDay(&woke[late]);
+    Terminate(0);
+}
+
+static void until(int tick)
+{
+    int deadline = JUST_BEFORE(tick);
+    int now;
+
+    SleepUntil(deadline);
+    GetTimeofDay(&now);
+    if (now < deadline) {
+        USLOSS_Console("start4(): SleepUntil(tick %d) woke early\n", tick);
+    }
+    else if (now - deadline >= PERIOD_US) {
+        USLOSS_Console("start4(): SleepUntil(tick %d) woke a tick late\n", tick);
+    }
+    else {
+        USLOSS_Console("start4(): SleepUntil(tick %d) woke on it\n", tick);
+    }
+}
+
+int start4(void *arg)
+{
+    int pid, status;
+
+    testcase_timeout = 30;
+
+    Spawn("Early", Sleeper, NULL, USLOSS_MIN_STACK, 2, &pid);
+    Spawn("Late", Sleeper, "late", USLOSS_MIN_STACK, 2, &pid);
+
+    until(64);
+    until(128);
+
+    Wait(&pid, &status);
+    Wait(&pid, &status);
+    if (woke[1] - woke[0] >= PERIOD_US) {
+        USLOSS_Console("start4(): Sleep woke Early a tick before Late\n");
+    }
+    else {
+        USLOSS_Console("start4(): Sleep woke Early and Late together\n");
+    }
+
+    Terminate(0);
+}
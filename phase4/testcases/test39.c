@@ -0,0 +1,62 @@
+/* DISKTEST
+ * Write combining across I/O classes: while disk 0 is busy, an idle class
+ * child and then a realtime class child write the same sector of track 5.
+ * The driver takes the realtime write first and combines the idle one with
+ * it, but the write that arrived last must still win, both in the block
+ * cache and on the disk.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <phase4.h>
+#include <phase4_usermode.h>
+
+static char busyBuf[16 * 512];
+static char writeBuf[2][512];
+static char readBuf[512];
+static char fillBuf[16 * 512];
+
+int Writer(void *arg)
+{
+    int ioClass = (int)(long)arg;
+    int id = (ioClass == DISK_CLASS_REALTIME);
+    int status;
+
+    DiskSetClass(ioClass);
+    sprintf(writeBuf[id], "%s write", id ? "realtime" : "idle");
+    DiskWrite(writeBuf[id], 0, 5, 0, 1, &status);
+    USLOSS_Console("Writer(): %s finished with status %d\n", writeBuf[id], status);
+    Terminate(0);
+}
+
+int start4(void *arg)
+{
+    int pid, status, ticket, i;
+
+    // keep the driver busy on another track while the two writes queue up
+    DiskWriteAsync(busyBuf, 0, 10, 0, 16, -1, &ticket);
+    Spawn("Idle", Writer, (void *)(long)DISK_CLASS_IDLE, USLOSS_MIN_STACK, 2, &pid);
+    Spawn("Realtime", Writer, (void *)(long)DISK_CLASS_REALTIME, USLOSS_MIN_STACK, 2, &pid);
+    DiskWait(ticket, &status);
+    Wait(&pid, &status);
+    Wait(&pid, &status);
+
+    DiskRead(readBuf, 0, 5, 0, 1, &status);
+    USLOSS_Console("start4(): cached track 5 sector 0: %s\n", readBuf);
+
+    // Read enough of disk 1 to evict every cached block
+    for (i = 0; i < 6; i++) {
+        DiskRead(fillBuf, 1, i, 0, 16, &status);
+    }
+
+    DiskRead(readBuf, 0, 5, 0, 1, &status);
+    USLOSS_Console("start4(): track 5 sector 0 on disk: %s\n", readBuf);
+
+    Terminate(0);
+}
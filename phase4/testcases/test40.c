@@ -0,0 +1,59 @@
+/* DISKTEST
+ * Block cache eviction: read every other sector of disk 1 until the cache
+ * is full, read the first one again, then one more sector. The cache has
+ * to drop a block for it, and it should drop the least recently used one,
+ * the second sector read, not the first. The reads skip a sector each time
+ * so none of them is sequential and nothing is read ahead.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <phase4.h>
+#include <phase4_usermode.h>
+
+static char buf[512];
+
+// reads one sector of disk 1 and says whether the device was used for it
+static int readSector(int sector)
+{
+    DiskStats before, after;
+    int status;
+
+    DeviceStats(USLOSS_DISK_DEV, 1, &before);
+    DiskRead(buf, 1, sector / USLOSS_DISK_TRACK_SIZE, sector % USLOSS_DISK_TRACK_SIZE, 1, &status);
+    DeviceStats(USLOSS_DISK_DEV, 1, &after);
+    return after.sectorsRead - before.sectorsRead;
+}
+
+static void reread(int sector)
+{
+    USLOSS_Console("start4(): sector %d read again from the %s\n", sector,
+                   readSector(sector) ? "disk" : "cache");
+}
+
+int start4(void *arg)
+{
+    int misses = 0;
+
+    for (int i = 0; i < DISK_CACHE_BLOCKS; i++) {
+        misses += readSector(2 * i);
+    }
+    USLOSS_Console("start4(): %d of %d sectors came from the disk\n", misses, DISK_CACHE_BLOCKS);
+
+    reread(0);
+    readSector(2 * DISK_CACHE_BLOCKS);
+    USLOSS_Console("start4(): read sector %d, %d evictions\n", 2 * DISK_CACHE_BLOCKS,
+                   diskCacheStats.evictions);
+
+    reread(0);
+    reread(2 * DISK_CACHE_BLOCKS);
+    reread(2);
+
+    Terminate(0);
+}
@@ -0,0 +1,65 @@
+/* DISKTEST
+ * Write-back cache. Built by the Makefile against a phase4.c compiled with
+ * -DDISK_CACHE_WRITEBACK=1. A DiskWrite stays in the cache, so the disk file
+ * keeps the old data until DiskSync writes it back. A write that nobody
+ * syncs reaches the file once DiskFlusher has run, within
+ * DISK_CACHE_FLUSH_SECS seconds. The test looks at the disk file itself.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <phase4.h>
+#include <phase4_usermode.h>
+
+#define TRACK  20
+#define SECTOR 3
+
+static char buf[512];
+
+// prints what the disk1 file has in the test's sector
+static void onDisk(char *when)
+{
+    char data[512];
+    FILE *disk = fopen("disk1", "r");
+
+    fseek(disk, (TRACK * USLOSS_DISK_TRACK_SIZE + SECTOR) * 512L, SEEK_SET);
+    fread(data, 1, sizeof(data), disk);
+    fclose(disk);
+    USLOSS_Console("start4(): %s, disk1 has \"%s\"\n", when, data);
+}
+
+static void writeText(char *text)
+{
+    int status;
+
+    memset(buf, 0, sizeof(buf));
+    strcpy(buf, text);
+    DiskWrite(buf, 1, TRACK, SECTOR, 1, &status);
+}
+
+int start4(void *arg)
+{
+    USLOSS_Console("start4(): DISK_CACHE_WRITEBACK is %d\n", DISK_CACHE_WRITEBACK);
+
+    writeText("old");
+    DiskSync(1);
+    onDisk("after DiskSync");
+
+    writeText("new");
+    onDisk("after DiskWrite");
+    DiskSync(1);
+    onDisk("after DiskSync");
+
+    writeText("flushed");
+    Sleep(DISK_CACHE_FLUSH_SECS + 1);
+    onDisk("after DiskFlusher");
+
+    USLOSS_Console("start4(): %d blocks written back\n", diskCacheStats.writebacks);
+    Terminate(0);
+}
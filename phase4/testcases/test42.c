@@ -0,0 +1,55 @@
+/* DISKTEST
+ * Sequential read-ahead: read the last four tracks of disk 0 four sectors
+ * at a time, pausing after each read so the prefetch it starts can finish.
+ * After the first few reads the kernel should prefetch what comes next, so
+ * most of the reads are answered by the cache, and it should stop
+ * prefetching at the end of the disk: the device reads each sector once and
+ * none past the end.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <phase3.h>
+#include <phase3_usermode.h>
+#include <phase4.h>
+#include <phase4_usermode.h>
+
+#define FIRST_TRACK 12
+#define CHUNK       4
+
+static char buf[CHUNK * 512];
+
+int start4(void *arg)
+{
+    DiskStats before, after;
+    DiskCacheStats cacheBefore;
+    int sectorSize, trackSize, tracks, status;
+
+    DiskSize(0, &sectorSize, &trackSize, &tracks);
+    USLOSS_Console("start4(): disk 0 has %d tracks\n", tracks);
+
+    DeviceStats(USLOSS_DISK_DEV, 0, &before);
+    cacheBefore = diskCacheStats;
+
+    int sectors = (tracks - FIRST_TRACK) * trackSize;
+    for (int i = 0; i < sectors; i += CHUNK) {
+        DiskRead(buf, 0, FIRST_TRACK + i / trackSize, i % trackSize, CHUNK, &status);
+        if (status != USLOSS_DEV_READY) {
+            USLOSS_Console("start4(): read of sector %d failed\n", i);
+        }
+        SleepMs(100);
+    }
+
+    DeviceStats(USLOSS_DISK_DEV, 0, &after);
+    USLOSS_Console("start4(): read %d sectors: %d from the cache, %d from the device\n", sectors,
+                   diskCacheStats.hits - cacheBefore.hits, diskCacheStats.misses - cacheBefore.misses);
+    USLOSS_Console("start4(): %d sectors read ahead\n", diskCacheStats.readAheads - cacheBefore.readAheads);
+    USLOSS_Console("start4(): the device read %d sectors in %d requests\n",
+                   after.sectorsRead - before.sectorsRead, after.reads - before.reads);
+
+    Terminate(0);
+}
@@ -5,12 +5,14 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <string.h>
 #include "project.h"
 #include "globals.h"
 #include "usloss.h"
 #include "dev_disk.h"
 #include "devices.h"
+#include "sig_ints.h"
 
 typedef struct {
     int				fd;		// Open fd for disk file. 
@@ -18,10 +20,71 @@ typedef struct {
     int				currentTrack;	// head position
     int				status;		// Disk's status
     USLOSS_DeviceRequest	request;	// Current request
+    char			*map;		// disk file mapped by --disk-mmap, or NULL
+    size_t			size;		// bytes mapped
+    USLOSS_DiskCommand		queue[USLOSS_DISK_QUEUE_MAX];	// in arrival order
+    int				queued;		// commands in queue
+    int				up;		// elevator direction
+    int				cylinder;	// head position in the disk model
+    int				owed;		// us of model time not yet in a tick
 } DiskInfo;
 
 static DiskInfo		disks[USLOSS_DISK_UNITS];
 
+/*
+ *  Set from the command line by main().
+ */
+dynamic_def(int disk_mmap = FALSE);
+dynamic_def(int disk_sync = DISK_SYNC_HALT);
+dynamic_def(int disk_queue_depth = 1);
+dynamic_def(int disk_queue_order = DISK_ORDER_SSTF);
+
+/*
+ *  A multi-sector request costs one tick to start plus one tick for every
+ *  DISK_SECTORS_PER_TICK sectors, or part of that, after the first, so a
+ *  single sector takes as long as a plain read or write and a whole track
+ *  takes 4 ticks.
+ */
+#define DISK_SECTORS_PER_TICK	5
+
+/*
+ *  How long an operation takes. The toy model, the default, keeps the tick
+ *  counts above and the seek of 1 + |distance| % 10 ticks, at most 3. The
+ *  others add up microseconds, for the controller, the seek curve, the wait
+ *  for the sector to come round and the transfer, and round the total to
+ *  ticks, carrying what is left to the unit's next operation.
+ *
+ *  Requests still address USLOSS_DISK_TRACK_SIZE sectors to a track. The
+ *  model's sectors per track is the physical geometry: the disk's sectors are
+ *  laid out in order on cylinders of that many, the way a drive maps its
+ *  blocks, and seeks are counted in those cylinders.
+ */
+typedef struct {
+    char	*name;
+    int		toy;		// the tick counts above; nothing below is used
+    int		seek_curve;	// DISK_SEEK_LINEAR or DISK_SEEK_SQRT
+    int		seek_min;	// us, to the next cylinder
+    int		seek_max;	// us, from one edge of the disk to the other
+    int		rpm;		// 0 if nothing rotates
+    int		sectors_per_track;
+    int		rate;		// KB/s transferred when rpm is 0
+    int		overhead;	// us for the controller, every operation
+} DiskModel;
+
+#define DISK_SEEK_LINEAR	0
+#define DISK_SEEK_SQRT		1
+
+static DiskModel disk_profiles[] = {
+    { "toy", TRUE, 0, 0, 0, 0, 0, 0, 0 },
+    { "hdd", FALSE, DISK_SEEK_SQRT, 800, 16000, 7200, 64, 0, 150 },
+    { "ssd", FALSE, DISK_SEEK_LINEAR, 0, 0, 0, 64, 400000, 60 },
+};
+
+static DiskModel disk_model = { "toy", TRUE, 0, 0, 0, 0, 0, 0, 0 };
+
+#define DISK_MULTI_FIRST(reg1)	((int) ((long) (reg1) & 0xff))
+#define DISK_MULTI_COUNT(reg1)	((int) ((long) (reg1) >> 8))
+
 /*
  *  Initialize all disk handling code.
  */
@@ -47,10 +110,390 @@ dynamic_fun void disk_init(void)
 		(USLOSS_DISK_TRACK_SIZE * USLOSS_DISK_SECTOR_SIZE);
 	    disks[i].currentTrack = 0;
 	    disks[i].status = USLOSS_DEV_READY;
+	    disks[i].map = NULL;
+	    disks[i].size = 0;
+	    disks[i].queued = 0;
+	    disks[i].up = 1;
+	    disks[i].cylinder = 0;
+	    disks[i].owed = 0;
+	    /*  Map the whole disk, so a transfer is a memcpy instead of two
+		system calls. An empty disk has nothing to map. */
+	    if (disk_mmap && disks[i].fd != -1 && disks[i].tracks > 0) {
+		disks[i].size = (size_t) disks[i].tracks *
+		    USLOSS_DISK_TRACK_SIZE * USLOSS_DISK_SECTOR_SIZE;
+		disks[i].map = mmap(NULL, disks[i].size, PROT_READ | PROT_WRITE,
+				    MAP_SHARED, disks[i].fd, 0);
+		usloss_sys_assert(disks[i].map != MAP_FAILED,
+		    "error mapping disk file");
+	    }
+	}
+    }
+}
+
+/*
+ *  Writes every mapped disk back to its file, if the sync policy asks for
+ *  it. Called when the simulation halts.
+ */
+dynamic_fun void disk_halt(void)
+{
+    int i;
+    int err_return;
+
+    for (i = 0; i < USLOSS_DISK_UNITS; i++) {
+	if (disks[i].map != NULL && disk_sync != DISK_SYNC_NONE) {
+	    err_return = msync(disks[i].map, disks[i].size, MS_SYNC);
+	    usloss_sys_assert(err_return != -1, "error syncing disk file");
+	}
+    }
+}
+
+/*
+ *  Moves count sectors, starting at sector first of the current track,
+ *  between the disk and buffer. A mapped disk is copied to or from directly,
+ *  and with the write policy each write is synced before the interrupt.
+ */
+static void disk_transfer(int unit, int write_op, int first, int count,
+			  void *buffer)
+{
+    long seek_loc;
+    size_t bytes = count * USLOSS_DISK_SECTOR_SIZE;
+    int err_return;
+
+    seek_loc = ((disks[unit].currentTrack * USLOSS_DISK_TRACK_SIZE) + 
+		first) * USLOSS_DISK_SECTOR_SIZE;
+    if (disks[unit].map != NULL)
+    {
+	if (write_op)
+	{
+	    memcpy(disks[unit].map + seek_loc, buffer, bytes);
+	    if (disk_sync == DISK_SYNC_WRITE)
+	    {
+		long page = sysconf(_SC_PAGESIZE);
+		long start = seek_loc - seek_loc % page;
+
+		err_return = msync(disks[unit].map + start,
+				   seek_loc + bytes - start, MS_SYNC);
+		usloss_sys_assert(err_return != -1, "error syncing disk file");
+	    }
 	}
+	else
+	    memcpy(buffer, disks[unit].map + seek_loc, bytes);
+	return;
+    }
+    err_return = lseek(disks[unit].fd, seek_loc, 0);
+    usloss_sys_assert(err_return != -1, "error seeking in disk file");
+    if (write_op)
+    {
+	err_return = write(disks[unit].fd, buffer, bytes);
+	usloss_sys_assert(err_return != -1, 
+	    "error writing to disk file");
+    }
+    else
+    {
+	err_return = read(disks[unit].fd, buffer, bytes);
+	usloss_sys_assert(err_return == bytes, 
+	    "error reading from disk file");
     }
 }
 
+/*
+ *  Sets the disk model from a profile name, optionally followed by
+ *  ,key=value settings that override the profile's: seek=linear|sqrt,
+ *  seekmin, seekmax and overhead in microseconds, rpm, spt (sectors per
+ *  track) and rate (KB/s). Called by main() for --disk-model; returns -1,
+ *  after saying why, if the model makes no sense.
+ */
+dynamic_fun int disk_model_set(char *spec)
+{
+    char	buf[256];
+    char	*option;
+    char	*value;
+    char	*end;
+    long	number;
+    int		i;
+    int		found = FALSE;
+
+    strncpy(buf, spec, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    option = strtok(buf, ",");
+    for (i = 0; option != NULL && i < sizeof(disk_profiles) / sizeof(disk_profiles[0]); i++) {
+	if (strcmp(option, disk_profiles[i].name) == 0) {
+	    disk_model = disk_profiles[i];
+	    found = TRUE;
+	}
+    }
+    if (!found) {
+	fprintf(stderr, "Unknown disk model %s\n", option == NULL ? "" : option);
+	return -1;
+    }
+
+    while ((option = strtok(NULL, ",")) != NULL) {
+	value = strchr(option, '=');
+	if (value == NULL || disk_model.toy) {
+	    fprintf(stderr, "Bad disk model setting %s\n", option);
+	    return -1;
+	}
+	*value++ = '\0';
+	if (strcmp(option, "seek") == 0) {
+	    if (strcmp(value, "linear") == 0) {
+		disk_model.seek_curve = DISK_SEEK_LINEAR;
+	    } else if (strcmp(value, "sqrt") == 0) {
+		disk_model.seek_curve = DISK_SEEK_SQRT;
+	    } else {
+		fprintf(stderr, "Unknown seek curve %s\n", value);
+		return -1;
+	    }
+	    continue;
+	}
+	number = strtol(value, &end, 10);
+	if (*value == '\0' || *end != '\0' || number < 0 || number > 100000000) {
+	    fprintf(stderr, "Bad disk model %s %s\n", option, value);
+	    return -1;
+	}
+	if (strcmp(option, "seekmin") == 0) {
+	    disk_model.seek_min = number;
+	} else if (strcmp(option, "seekmax") == 0) {
+	    disk_model.seek_max = number;
+	} else if (strcmp(option, "rpm") == 0) {
+	    disk_model.rpm = number;
+	} else if (strcmp(option, "spt") == 0) {
+	    disk_model.sectors_per_track = number;
+	} else if (strcmp(option, "rate") == 0) {
+	    disk_model.rate = number;
+	} else if (strcmp(option, "overhead") == 0) {
+	    disk_model.overhead = number;
+	} else {
+	    fprintf(stderr, "Unknown disk model setting %s\n", option);
+	    return -1;
+	}
+    }
+
+    if (!disk_model.toy && (disk_model.sectors_per_track < 1 ||
+	disk_model.seek_max < disk_model.seek_min ||
+	(disk_model.rpm == 0 && disk_model.rate == 0))) {
+	fprintf(stderr, "Disk model %s needs spt > 0, seekmax >= seekmin, "
+		"and an rpm or a rate\n", spec);
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ *  The square root of n, rounded down.
+ */
+static long disk_isqrt(long n)
+{
+    long root = 0;
+    long bit = 1L << 30;
+
+    while (bit > n)
+	bit >>= 2;
+    while (bit != 0) {
+	if (n >= root + bit) {
+	    n -= root + bit;
+	    root = (root >> 1) + bit;
+	} else
+	    root >>= 1;
+	bit >>= 2;
+    }
+    return root;
+}
+
+/*
+ *  Microseconds to move the head of a unit to a cylinder, on the model's
+ *  seek curve: seek_min for the next cylinder, rising to seek_max for the
+ *  full width of the disk.
+ */
+static long disk_seek_time(int unit, int cylinder)
+{
+    long distance = abs(cylinder - disks[unit].cylinder);
+    long cylinders = ((long) disks[unit].tracks * USLOSS_DISK_TRACK_SIZE +
+		      disk_model.sectors_per_track - 1) /
+		     disk_model.sectors_per_track;
+    long span = disk_model.seek_max - disk_model.seek_min;
+    long fraction;		/* of the way from 1 cylinder to all, in millionths */
+
+    if (distance == 0)
+	return 0;
+    fraction = (cylinders > 2) ? (distance - 1) * 1000000 / (cylinders - 2) : 0;
+    if (disk_model.seek_curve == DISK_SEEK_SQRT)
+	return disk_model.seek_min + span * disk_isqrt(fraction) / 1000;
+    return disk_model.seek_min + span * fraction / 1000000;
+}
+
+/*
+ *  Microseconds the model gives an operation on count sectors from sector
+ *  first of a track; a count of 0 only seeks, and a track of -1 neither
+ *  seeks nor transfers. Leaves the head where the operation will. The
+ *  rotation is timed from the simulated clock, so the wait for a sector
+ *  depends on when it is asked for.
+ */
+static long disk_time(int unit, int track, int first, int count)
+{
+    long us = disk_model.overhead;
+    long block = (long) track * USLOSS_DISK_TRACK_SIZE + first;
+    long revolution;
+    long angle;
+    long target;
+    int spt = disk_model.sectors_per_track;
+
+    if (track < 0 || track >= disks[unit].tracks || first < 0 ||
+	first >= USLOSS_DISK_TRACK_SIZE)
+	return us;
+    us += disk_seek_time(unit, block / spt);
+    disks[unit].cylinder = block / spt;
+    if (count < 1)
+	return us;
+
+    if (disk_model.rpm > 0) {
+	revolution = 60000000L / disk_model.rpm;
+	angle = ((long) pclock_ticks * ALARM_TIME + partial_ticks + us) % revolution;
+	target = (block % spt) * revolution / spt;
+	us += (target - angle + revolution) % revolution;
+	us += count * revolution / spt;
+    } else
+	us += count * 500000L / disk_model.rate;	/* 512 bytes at rate KB/s */
+    disks[unit].cylinder = (block + count - 1) / spt;
+    return us;
+}
+
+/*
+ *  Ticks an operation takes, at least one; the arguments are those of
+ *  disk_time().
+ */
+static int disk_delay(int unit, int track, int first, int count)
+{
+    DiskInfo *disk = &disks[unit];
+    long owed;
+    int delay = 0;
+
+    if (disk_model.toy) {
+	/*  A disk access should take 30ms (3 ticks), tops. */
+	if (track != -1 && (count == 0 || track != disk->currentTrack)) {
+	    delay = 1 + (abs(disk->currentTrack - track) % 10);
+	    if (delay > 3)
+		delay = 3;
+	}
+	if (count == 1)
+	    delay += 1;
+	else if (count > 1)
+	    delay += 1 + (count - 1 + DISK_SECTORS_PER_TICK - 1) /
+		DISK_SECTORS_PER_TICK;
+	return (delay < 1) ? 1 : delay;
+    }
+
+    if (track == -1 && count > 0)
+	track = disk->currentTrack;
+    owed = disk->owed + disk_time(unit, track, first, count);
+    delay = owed / DEVICE_TICK_TIME;
+    if (delay < 1)
+	delay = 1;
+    owed -= (long) delay * DEVICE_TICK_TIME;
+    disk->owed = (owed < 0) ? 0 : owed;
+    return delay;
+}
+
+/*
+ *  Ticks a queued command takes: the seek, if it is on another track, plus
+ *  the transfer, timed like the single- and multi-sector operations.
+ */
+static int disk_queue_delay(int unit, USLOSS_DiskCommand *command)
+{
+    return disk_delay(unit, command->track, command->first, command->count);
+}
+
+/*
+ *  Picks the queued command to serve next, by disk_queue_order, and moves it
+ *  to the front of the queue.
+ */
+static void disk_queue_next(int unit)
+{
+    DiskInfo *disk = &disks[unit];
+    USLOSS_DiskCommand chosen;
+    int best = 0;
+    int i, distance, best_distance;
+
+    if (disk_queue_order == DISK_ORDER_SSTF) {
+	best_distance = abs(disk->queue[0].track - disk->currentTrack);
+	for (i = 1; i < disk->queued; i++) {
+	    distance = abs(disk->queue[i].track - disk->currentTrack);
+	    if (distance < best_distance) {
+		best = i;
+		best_distance = distance;
+	    }
+	}
+    } else if (disk_queue_order == DISK_ORDER_ELEVATOR) {
+	/*  The nearest command on the way the head is going; turn around
+	    if there is none */
+	best = -1;
+	while (best == -1) {
+	    for (i = 0; i < disk->queued; i++) {
+		distance = disk->up ? disk->queue[i].track - disk->currentTrack
+				    : disk->currentTrack - disk->queue[i].track;
+		if (distance >= 0 && (best == -1 || distance < best_distance)) {
+		    best = i;
+		    best_distance = distance;
+		}
+	    }
+	    if (best == -1)
+		disk->up = !disk->up;
+	}
+    }
+
+    /*  Keep the rest in arrival order, so ties go first come first */
+    chosen = disk->queue[best];
+    memmove(&disk->queue[1], &disk->queue[0], best * sizeof(chosen));
+    disk->queue[0] = chosen;
+}
+
+/*
+ *  Adds a command to a unit's queue, and starts it if the disk is idle.
+ */
+static int disk_queue(int unit, USLOSS_DiskCommand *command)
+{
+    DiskInfo *disk = &disks[unit];
+
+    if (disk->queued >= disk_queue_depth)
+	return USLOSS_DEV_BUSY;
+    disk->queue[disk->queued++] = *command;
+    if (disk->queued == 1)
+	schedule_int(USLOSS_DISK_INT, (void *) unit,
+		     disk_queue_delay(unit, &disk->queue[0]));
+    return USLOSS_DEV_OK;
+}
+
+/*
+ *  Carries out the queued command at the front of the queue, which has just
+ *  finished, and starts the next one.
+ */
+static int disk_queue_action(int unit)
+{
+    DiskInfo *disk = &disks[unit];
+    USLOSS_DiskCommand *command = &disk->queue[0];
+    int status = USLOSS_DEV_READY;
+
+    if ((command->opr != USLOSS_DISK_READ && command->opr != USLOSS_DISK_WRITE) ||
+	(command->track < 0) || (command->track >= disk->tracks) ||
+	(command->first < 0) || (command->count < 1) ||
+	(command->first + command->count > USLOSS_DISK_TRACK_SIZE))
+	status = USLOSS_DEV_ERROR;
+    else {
+	disk->currentTrack = command->track;
+	disk_transfer(unit, command->opr == USLOSS_DISK_WRITE, command->first,
+		      command->count, command->buffer);
+    }
+    disk->status = status | (command->tag << 8);
+
+    disk->queued--;
+    memmove(&disk->queue[0], &disk->queue[1], disk->queued * sizeof(*command));
+    if (disk->queued > 0) {
+	disk_queue_next(unit);
+	schedule_int(USLOSS_DISK_INT, (void *) unit,
+		     disk_queue_delay(unit, &disk->queue[0]));
+    }
+    return unit;
+}
+
 /*
  *  Returns the current device status of the disk.  Resets the status to
  *  DEV_READY if the last I/O operation resulted in an error.
@@ -61,7 +504,7 @@ dynamic_fun int disk_get_status(int unit, int *statusPtr)
 	return USLOSS_DEV_INVALID;
     }
     *statusPtr = disks[unit].status;
-    if (*statusPtr == USLOSS_DEV_ERROR) {
+    if (USLOSS_DISK_STAT(*statusPtr) == USLOSS_DEV_ERROR) {
 	disks[unit].status = USLOSS_DEV_READY;
     }
     return USLOSS_DEV_OK;
@@ -86,21 +529,38 @@ dynamic_fun int disk_request(int unit, void *arg)
 	rc = USLOSS_DEV_BUSY;
 	goto done;
     }
+    if (request -> opr == USLOSS_DISK_QUEUE) {
+	rc = disk_queue(unit, (USLOSS_DiskCommand *) request -> reg1);
+	goto done;
+    }
+    if (disks[unit].queued > 0) {
+	rc = USLOSS_DEV_BUSY;
+	goto done;
+    }
     disks[unit].status = USLOSS_DEV_BUSY;
 
     /*  Store the new request data, calculate
 	the delay to fulfill the request, and schedule the interrupt */
     memcpy(&disks[unit].request, request, sizeof(*request));
-    /* 
-     * A disk access should take 30ms (3 ticks), tops.
-     */
-    if (request -> opr == USLOSS_DISK_SEEK)
-	delay = 1 + (abs((disks[unit].currentTrack) - 
-	    ((int) request -> reg1)) % 10);
-    else 
-	delay = 1;
-    if (delay > 3)
-	delay = 3;
+    switch (request -> opr)
+    {
+      case USLOSS_DISK_SEEK:
+	delay = disk_delay(unit, (int) request -> reg1, 0, 0);
+	break;
+      case USLOSS_DISK_READ:
+      case USLOSS_DISK_WRITE:
+	delay = disk_delay(unit, -1, (int) request -> reg1, 1);
+	break;
+      case USLOSS_DISK_READ_MULTI:
+      case USLOSS_DISK_WRITE_MULTI:
+	/* Multi-sector transfers take time in proportion to their length. */
+	delay = disk_delay(unit, -1, DISK_MULTI_FIRST(request -> reg1),
+			   DISK_MULTI_COUNT(request -> reg1));
+	break;
+      default:
+	delay = disk_delay(unit, -1, 0, 0);
+	break;
+    }
     schedule_int(USLOSS_DISK_INT, (void *) unit, delay);
     rc = USLOSS_DEV_OK;
 done:
@@ -120,13 +580,14 @@ done:
 dynamic_fun int disk_action(void *arg)
 {
     int status = USLOSS_DEV_READY;
-    long seek_loc;
-    int err_return;
     int unit = (int) arg;
+    int first, count;
     USLOSS_DeviceRequest *request;
 
     usloss_sys_assert((unit >= 0) && (unit < USLOSS_DISK_UNITS), 
 	"invalid disk unit in disk_action");
+    if (disks[unit].queued > 0)
+	return disk_queue_action(unit);
     request = &disks[unit].request;
 
     switch(request->opr)
@@ -143,26 +604,18 @@ dynamic_fun int disk_action(void *arg)
 	if (((int)request->reg1) >= USLOSS_DISK_TRACK_SIZE)
 	    status = USLOSS_DEV_ERROR;
 	else
-	{
-	    seek_loc = ((disks[unit].currentTrack * USLOSS_DISK_TRACK_SIZE) + 
-			((int)request->reg1)) * USLOSS_DISK_SECTOR_SIZE;
-	    err_return = lseek(disks[unit].fd, seek_loc, 0);
-	    usloss_sys_assert(err_return != -1, "error seeking in disk file");
-	    if (request->opr == USLOSS_DISK_WRITE)
-	    {
-		err_return = write(disks[unit].fd, request->reg2,
-				   USLOSS_DISK_SECTOR_SIZE);
-		usloss_sys_assert(err_return != -1, 
-		    "error writing to disk file");
-	    }
-	    else
-	    {
-		err_return = read(disks[unit].fd, (void *) request->reg2,
-				  USLOSS_DISK_SECTOR_SIZE);
-		usloss_sys_assert(err_return == USLOSS_DISK_SECTOR_SIZE, 
-		    "error reading from disk file");
-	    }
-	}
+	    disk_transfer(unit, request->opr == USLOSS_DISK_WRITE,
+			  (int) request->reg1, 1, request->reg2);
+	break;
+      case USLOSS_DISK_READ_MULTI:
+      case USLOSS_DISK_WRITE_MULTI:
+	first = DISK_MULTI_FIRST(request->reg1);
+	count = DISK_MULTI_COUNT(request->reg1);
+	if ((count < 1) || (first + count > USLOSS_DISK_TRACK_SIZE))
+	    status = USLOSS_DEV_ERROR;
+	else
+	    disk_transfer(unit, request->opr == USLOSS_DISK_WRITE_MULTI,
+			  first, count, request->reg2);
 	break;
       case USLOSS_DISK_TRACKS:
 	*((int *) request->reg1) = disks[unit].tracks;
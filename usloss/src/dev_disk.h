@@ -5,7 +5,28 @@
 #include "project.h"
 #include "usloss.h"
 
+/*
+ *  When a disk mapped with --disk-mmap is written back to its file.
+ */
+#define DISK_SYNC_HALT	0	/* when the simulation halts (the default) */
+#define DISK_SYNC_WRITE	1	/* after every write */
+#define DISK_SYNC_NONE	2	/* whenever the host gets around to it */
+
+/*
+ *  The order a disk run with --disk-queue serves its queued commands in.
+ */
+#define DISK_ORDER_SSTF		0	/* nearest track first (the default) */
+#define DISK_ORDER_ELEVATOR	1	/* sweep up, then down (SCAN) */
+#define DISK_ORDER_FIFO		2	/* as they arrive */
+
+dynamic_dcl int disk_mmap;
+dynamic_dcl int disk_sync;
+dynamic_dcl int disk_queue_depth;
+dynamic_dcl int disk_queue_order;
+
 dynamic_dcl void disk_init(void);
+dynamic_dcl void disk_halt(void);
+dynamic_dcl int disk_model_set(char *spec);
 dynamic_dcl int disk_get_status(int unit, int *status);
 dynamic_dcl int disk_request(int unit, void *request);
 dynamic_dcl int disk_action(void *arg);
@@ -1,10 +1,15 @@
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include "project.h"
 #include "globals.h"
 #include "dev_term.h"
+#include "sig_ints.h"
+#include "devices.h"
+
+#define TERM_INPUT_SIZE		4096
 
 /*
  * These structures keep track of the status of each terminal. 
@@ -14,10 +19,46 @@ typedef struct {
     FILE	*outputPtr;	/* output stream. */
     int		status;		/* its status register. */
     int		control;	/* its control register. */
+    int		unflushed;	/* characters written since the last flush. */
+    long long	since;		/* when the oldest of them was written. */
+    char	input[TERM_INPUT_SIZE];	/* read ahead from the input file. */
+    int		inputNext;	/* next character of input to receive. */
+    int		inputEnd;	/* end of what has been read. */
+    long long	recvDue;	/* when the next character arrives, by baud. */
+    long long	xmitDue;	/* when the character being sent is gone. */
 } TermInfo;
 
 static TermInfo terms[USLOSS_TERM_UNITS];
 
+/*
+ *  Receive and transmit rates, in baud, set from the command line by main()
+ *  with --term-baud. A unit with no rate is served the old way: the
+ *  terminal is the lowest-priority device, so each device tick no other
+ *  device wants goes to the next unit in turn, which receives a character
+ *  and finishes sending one then. A unit with a rate receives a character
+ *  every 10 bits' time and finishes sending one 10 bits' time after it was
+ *  started, checked on every device tick; so it moves at most a character
+ *  each way per tick, and rates above TERM_MAX_BAUD are refused.
+ */
+static int term_recv_baud[USLOSS_TERM_UNITS];
+static int term_xmit_baud[USLOSS_TERM_UNITS];
+
+/*
+ *  Set from the command line by main(). Output is buffered, and written to
+ *  the term*.out file at the end of each line, when TERM_BUFFER_SIZE
+ *  characters are waiting, when the oldest has waited TERM_FLUSH_TIME, and
+ *  when the simulation halts. --term-unbuffered writes every character as it
+ *  is sent, for watching a terminal as it runs.
+ */
+dynamic_def(int term_unbuffered = FALSE);
+
+#define TERM_BUFFER_SIZE	4096
+#define TERM_FLUSH_TIME		100000	/* microseconds */
+
+#define TERM_CHAR_TIME(baud)	(10000000 / (baud))	/* microseconds */
+#define TERM_MAX_BAUD		(10000000 / DEVICE_TICK_TIME)	/* a character a tick */
+#define TERM_NOW()		((long long) pclock_ticks * ALARM_TIME + partial_ticks)
+
 /* 
  * Handy macros.
  */
@@ -96,6 +137,14 @@ dynamic_dcl void term_init(void)
     {
 	filename[4] = '0' + count;
 	terms[count].outputPtr = safeopen(filename, "w");
+	terms[count].unflushed = 0;
+	terms[count].inputNext = 0;
+	terms[count].inputEnd = 0;
+	terms[count].recvDue = 0;
+	terms[count].xmitDue = 0;
+	if (!term_unbuffered) {
+	    setvbuf(terms[count].outputPtr, NULL, _IOFBF, TERM_BUFFER_SIZE);
+	}
     }
 
     /*  Now open the input files */
@@ -108,23 +157,95 @@ dynamic_dcl void term_init(void)
 }
 
 /*
- *  Special character input routine for buffered input. If getc()
- *  indicates that EOF has been reached, a read() is attempted to
- *  catch any character that may have been appended since the EOF
- *  was detected. This is a bit of a kludge, but it works.
+ *  Writes a terminal's buffered output to its file.
+ */
+static void term_flush(int unit)
+{
+    int err_return;
+
+    if (terms[unit].unflushed > 0) {
+	err_return = fflush(terms[unit].outputPtr);
+	usloss_sys_assert(err_return == 0, 
+	    "error on fflush of terminal device");
+	terms[unit].unflushed = 0;
+    }
+}
+
+/*
+ *  Writes every terminal's buffered output to its file. Called when the
+ *  simulation halts or aborts.
+ */
+dynamic_fun void term_halt(void)
+{
+    int count;
+
+    for (count = 0; count < USLOSS_TERM_UNITS; count++) {
+	if (terms[count].outputPtr != NULL) {
+	    term_flush(count);
+	}
+    }
+}
+
+/*
+ *  Sets the baud rate of the terminals from --term-baud=[UNIT:]RECV[/XMIT]:
+ *  of one unit, or of all of them if no unit is given; XMIT defaults to
+ *  RECV. Returns -1, after saying why, if the setting makes no sense or is
+ *  faster than the device tick can carry.
  */
-static int nextchr(FILE *stream)
+dynamic_fun int term_baud_set(char *spec)
 {
-    int c;
-    char ch;
-
-    c = getc(stream);
-    if (c != EOF) 
-	return c;
-    c = read(fileno(stream), &ch, 1);
-    if (c != 0)
-	return ch;
-    return EOF;
+    char	*end;
+    long	unit = -1;
+    long	recv;
+    long	xmit;
+    int		count;
+
+    recv = strtol(spec, &end, 10);
+    if (*end == ':') {
+	unit = recv;
+	recv = strtol(end + 1, &end, 10);
+    }
+    xmit = recv;
+    if (*end == '/')
+	xmit = strtol(end + 1, &end, 10);
+    if (*end != '\0' || unit < -1 || unit >= USLOSS_TERM_UNITS ||
+	recv < 1 || recv > 1000000 || xmit < 1 || xmit > 1000000) {
+	fprintf(stderr, "Bad terminal baud rate %s\n", spec);
+	return -1;
+    }
+    if (recv > TERM_MAX_BAUD || xmit > TERM_MAX_BAUD) {
+	fprintf(stderr, "Terminal baud rate %s is above %d, the most a "
+		"terminal can move at one character per device tick\n",
+		spec, TERM_MAX_BAUD);
+	return -1;
+    }
+    for (count = 0; count < USLOSS_TERM_UNITS; count++) {
+	if (unit == -1 || unit == count) {
+	    term_recv_baud[count] = recv;
+	    term_xmit_baud[count] = xmit;
+	}
+    }
+    return 0;
+}
+
+/*
+ *  Returns the next character of a terminal's input, or EOF. The input file
+ *  is read a block at a time; at its end, it is tried again every time, to
+ *  catch anything appended since.
+ */
+static int nextchr(int unit)
+{
+    TermInfo *term = &terms[unit];
+    int count;
+
+    if (term->inputNext == term->inputEnd) {
+	count = read(fileno(term->inputPtr), term->input, TERM_INPUT_SIZE);
+	if (count <= 0)
+	    return EOF;
+	term->inputNext = 0;
+	term->inputEnd = count;
+    }
+    return (unsigned char) term->input[term->inputNext++];
 }
 
 /*
@@ -170,9 +291,15 @@ dynamic_dcl int term_request(int unit, void *arg)
     		err_return = putc(ch, terms[unit].outputPtr);
     		usloss_sys_assert(err_return != EOF, 
     			"error on putc to terminal device");
-    		err_return = fflush(terms[unit].outputPtr);
-    		usloss_sys_assert(err_return == 0, 
-    			"error on fflush of terminal device");
+    		if (terms[unit].unflushed++ == 0) {
+    		    terms[unit].since = TERM_NOW();
+    		}
+    		if (term_xmit_baud[unit] > 0) {
+    		    terms[unit].xmitDue = TERM_NOW() + TERM_CHAR_TIME(term_xmit_baud[unit]);
+    		}
+    		if (term_unbuffered || ch == '\n') {
+    		    term_flush(unit);
+    		}
     		SET_XMIT_STATUS(terms[unit].status, USLOSS_DEV_BUSY);
     	} else if (USLOSS_TERM_STAT_XMIT(terms[unit].status) == USLOSS_DEV_BUSY) {
     	    return USLOSS_DEV_BUSY;
@@ -182,22 +309,23 @@ dynamic_dcl int term_request(int unit, void *arg)
 }
 
 /*
- *  Perform all actions necessary for reading a character from the terminal
- *  and setting up the device and unit status accordingly.
+ *  Receives the next character of a unit's input and finishes sending the
+ *  character it was sending, as asked, and sets up the unit's status
+ *  accordingly. Returns the unit if that raises an interrupt, else -1.
  */
-dynamic_dcl int term_action(void *arg)
+static int term_serve(int unit, int recv, int xmit)
 {
-    static int unit = -1;
     int in_char;
     int result = -1;
 
-    /*  Select the pseudoterminal to read from and get next character */ 
-    unit = (unit + 1) % 4;
-    //printf("term_action %d\n", unit);
-    //print_status(terms[unit].status);
-    //print_control(terms[unit].control);
-
-    in_char = nextchr(terms[unit].inputPtr);
+    in_char = recv ? nextchr(unit) : EOF;
+    if (recv && term_recv_baud[unit] > 0) {
+	/*  Characters come at the rate, from when there is one to send */
+	if (in_char == EOF || (char) in_char == '@' ||
+	    TERM_NOW() - terms[unit].recvDue > TERM_CHAR_TIME(term_recv_baud[unit]))
+	    terms[unit].recvDue = TERM_NOW();
+	terms[unit].recvDue += TERM_CHAR_TIME(term_recv_baud[unit]);
+    }
     //terms[unit].status = 0;
 
     /*  If we are not at EOF or the character is not an '@' sign (which
@@ -215,14 +343,14 @@ dynamic_dcl int term_action(void *arg)
 			result = unit;
 		}
     }
-    else {
+    else if (recv) {
     	SET_RECV_STATUS(terms[unit].status, USLOSS_DEV_READY);
     }
     /* 
      * If the xmit side is busy, then we just sent a character. Mark
      * the xmit side as ready.
      */
-    if (USLOSS_TERM_STAT_XMIT(terms[unit].status) == USLOSS_DEV_BUSY) {
+    if (xmit && USLOSS_TERM_STAT_XMIT(terms[unit].status) == USLOSS_DEV_BUSY) {
 	   SET_XMIT_STATUS(terms[unit].status, USLOSS_DEV_READY);
        // If xmit interrupt is enabled then generate an interrupt. 
 	   if (terms[unit].control & 0x4) {
@@ -232,3 +360,50 @@ dynamic_dcl int term_action(void *arg)
     return result;
 }
 
+/*
+ *  Perform all actions necessary for reading a character from the terminal
+ *  and setting up the device and unit status accordingly.
+ */
+dynamic_dcl int term_action(void *arg)
+{
+    static int unit = -1;
+
+    /*  Select the pseudoterminal to read from and get next character */ 
+    unit = (unit + 1) % 4;
+    //printf("term_action %d\n", unit);
+    //print_status(terms[unit].status);
+    //print_control(terms[unit].control);
+
+    /*  Output that has waited long enough goes out even without a newline */
+    if (terms[unit].unflushed > 0 && TERM_NOW() - terms[unit].since >= TERM_FLUSH_TIME) {
+	term_flush(unit);
+    }
+
+    /*  A unit with a baud rate keeps its own time, in term_baud_action() */
+    if (term_recv_baud[unit] > 0) {
+	return -1;
+    }
+    return term_serve(unit, TRUE, TRUE);
+}
+
+/*
+ *  Called every device tick for each unit, whatever device the tick went
+ *  to. A unit with a baud rate receives a character, and finishes sending
+ *  one, if its time has come. Returns the unit if that raises an interrupt,
+ *  else -1.
+ */
+dynamic_fun int term_baud_action(int unit)
+{
+    long long now = TERM_NOW();
+    int recv, xmit;
+
+    if (term_recv_baud[unit] == 0) {
+	return -1;
+    }
+    recv = now - terms[unit].recvDue >= 0;
+    xmit = now - terms[unit].xmitDue >= 0;
+    if (!recv && !xmit) {
+	return -1;
+    }
+    return term_serve(unit, recv, xmit);
+}
@@ -5,10 +5,15 @@
 #include "project.h"
 #include "usloss.h"
 
+dynamic_dcl int term_unbuffered;
+
 dynamic_dcl void term_init(void);
+dynamic_dcl void term_halt(void);
+dynamic_dcl int term_baud_set(char *spec);
 dynamic_dcl int term_get_status(int unit, int *status);
 dynamic_dcl int term_request(int unit, void *arg);
 dynamic_dcl int term_action(void *arg);
+dynamic_dcl int term_baud_action(int unit);
 
 #endif	/*  _dev_term_h */
 
@@ -1,5 +1,6 @@
 
 #include <stdio.h>
+#include <stdlib.h>
 #include "project.h"
 #include "globals.h"
 #include "usloss.h"
@@ -7,14 +8,48 @@
 #include "dev_clock.h"
 #include "dev_disk.h"
 #include "dev_term.h"
+#include "devices.h"
 
-static struct {
+/*
+ *  A device event. Times are in device ticks, counted from the start of the
+ *  simulation.
+ */
+typedef struct {
+    long long	time;		/* device tick it is due on */
+    long long	seq;		/* when it was scheduled, to break ties */
     int		device;
     void	*arg;
-} dev_event_queue[256];		// Indexed by unsigned char - must be
-				// 256 (major changes if not) */
+} DevEvent;
+
+/*
+ *  A binary heap of events, the first by its order at the top.
+ */
+typedef struct {
+    DevEvent	*events;
+    int		count;
+    int		size;
+    int		(*before)(DevEvent *a, DevEvent *b);
+} DevHeap;
+
+static int dev_timer_before(DevEvent *a, DevEvent *b);
+static int dev_ready_before(DevEvent *a, DevEvent *b);
 
-static unsigned char dev_event_ptr;	/*  Index into queue of pending ints */
+/*
+ *  Events wait in dev_timers, by when they are due. Once due they move to
+ *  dev_ready, by the priority of their device, and are delivered from there.
+ */
+static DevHeap	dev_timers = { NULL, 0, 0, dev_timer_before };
+static DevHeap	dev_ready = { NULL, 0, 0, dev_ready_before };
+static long long dev_tick;	/* device ticks so far */
+static long long dev_event_seq;
+
+/*
+ *  Set from the command line by main(). Each device tick normally delivers
+ *  one event, the most urgent one due, and anything else due waits for the
+ *  next tick, as it always has. With --batch-ints a tick delivers every
+ *  event due by then.
+ */
+dynamic_def(int dev_batch_ints = FALSE);
 
 void (*USLOSS_IntVec[USLOSS_NUM_INTS])(int dev, void *arg);	/*  Interrupt vector table */
      
@@ -26,9 +61,10 @@ dynamic_fun void devices_init(void)
     int count;
 
     /*  Initialize the device event queue */
-    for (count = 0; count < 256; count++)
-	dev_event_queue[count].device = LOW_PRI_DEV;
-    dev_event_ptr = 0;
+    dev_timers.count = 0;
+    dev_ready.count = 0;
+    dev_tick = 0;
+    dev_event_seq = 0;
     /*  Initialize the device status and interrupt vector tables */
     for (count = 0; count < USLOSS_NUM_INTS; count++)
     {
@@ -37,69 +73,122 @@ dynamic_fun void devices_init(void)
 }
 
 /*
- *  Schedule an interrupt for a given number of clock ticks (must be < 255)
- *  in the future.  When two interrupts are scheduled for the same tick,
- *  the interrupt with lower priority is assigned to a later tick.
+ *  Orders the waiting events: the one due first, then, for the same tick,
+ *  the one of the highest priority device (the lowest number), then the one
+ *  scheduled first.
  */
-dynamic_fun void schedule_int(int device, void *arg, int future_time)
+static int dev_timer_before(DevEvent *a, DevEvent *b)
 {
-    unsigned char index;	/* index MUST be char for wrap */
-    int 	low_pri_dev;
-    void 	*low_pri_arg;
+    if (a->time != b->time)
+	return a->time < b->time;
+    if (a->device != b->device)
+	return a->device < b->device;
+    return a->seq < b->seq;
+}
 
-    index = ((unsigned char) future_time) + dev_event_ptr;
-    do
-    {
-	/*  Loop until we find a lower priority device than current */
-	while(dev_event_queue[index].device <= device)
-	    index++;
-	/*  Swap the lower with the higher and continue */
-	low_pri_dev = dev_event_queue[index].device;
-	low_pri_arg = dev_event_queue[index].arg;
-	dev_event_queue[index].device = device;
-	dev_event_queue[index].arg = arg;
-	device = low_pri_dev;
-	arg = low_pri_arg;
+/*
+ *  Orders the events due: the one of the highest priority device, then the
+ *  one due first, then the one scheduled first. A later event of a higher
+ *  priority device goes ahead of one that has been kept waiting.
+ */
+static int dev_ready_before(DevEvent *a, DevEvent *b)
+{
+    if (a->device != b->device)
+	return a->device < b->device;
+    if (a->time != b->time)
+	return a->time < b->time;
+    return a->seq < b->seq;
+}
+
+/*
+ *  Adds an event to a heap.
+ */
+static void dev_heap_push(DevHeap *heap, DevEvent *event)
+{
+    int index;
+    int parent;
+
+    if (heap->count == heap->size) {
+	heap->size = (heap->size == 0) ? 16 : 2 * heap->size;
+	heap->events = realloc(heap->events, heap->size * sizeof(DevEvent));
+	usloss_sys_assert(heap->events != NULL,
+	    "error growing device event queue");
+    }
+    index = heap->count++;
+    while (index > 0) {
+	parent = (index - 1) / 2;
+	if (!heap->before(event, &heap->events[parent]))
+	    break;
+	heap->events[index] = heap->events[parent];
+	index = parent;
     }
-    while(low_pri_dev != LOW_PRI_DEV);
+    heap->events[index] = *event;
 }
 
 /*
- *  Gets the next event from the queue at interrupt time and performs
- *  all processing needed for this interrupt - calling the device
- *  action routine and the user interrupt handler.
+ *  Takes the first event off a heap, which must not be empty.
  */
-dynamic_fun void dispatch_int(void)
+static void dev_heap_pop(DevHeap *heap, DevEvent *event)
 {
-    static unsigned int tick = 0;
-    int event_device;
-    int unit_num = -1;
-    void *arg;
+    DevEvent	last;
+    int		index = 0;
+    int		child;
 
-    /*  Update and check the 'tick' variable to see if this is a clock
-	interrupt */
-    tick = ~tick;
-    if (tick)
-    {
-        LOG(CLOCK_VERBOSITY, "Interrupt: %d (CLOCK), handler @ %p\n",
-            USLOSS_CLOCK_INT, USLOSS_IntVec[USLOSS_CLOCK_INT]);
-        clock_action();
-        if (USLOSS_IntVec[USLOSS_CLOCK_INT] == NULL) {
-            rpt_sim_trap("USLOSS_IntVec[USLOSS_CLOCK_INT] is NULL!\n");
-        }
+    *event = heap->events[0];
+    last = heap->events[--heap->count];
+    while ((child = 2 * index + 1) < heap->count) {
+	if (child + 1 < heap->count &&
+	    heap->before(&heap->events[child + 1], &heap->events[child]))
+	    child++;
+	if (!heap->before(&heap->events[child], &last))
+	    break;
+	heap->events[index] = heap->events[child];
+	index = child;
+    }
+    heap->events[index] = last;
+}
 
-        (*USLOSS_IntVec[USLOSS_CLOCK_INT])(USLOSS_CLOCK_DEV, 0);
-        return;
+/*
+ *  Takes the next event to deliver this tick off the queue, if one is due.
+ */
+static int dev_event_next(DevEvent *event)
+{
+    DevEvent due;
+
+    while (dev_timers.count > 0 && dev_timers.events[0].time <= dev_tick) {
+	dev_heap_pop(&dev_timers, &due);
+	dev_heap_push(&dev_ready, &due);
     }
+    if (dev_ready.count == 0)
+	return FALSE;
+    dev_heap_pop(&dev_ready, event);
+    return TRUE;
+}
+
+/*
+ *  Schedule an interrupt for a given number of device ticks in the future.
+ *  When two interrupts are due on the same tick, the one of lower priority
+ *  waits for a later tick (unless --batch-ints).
+ */
+dynamic_fun void schedule_int(int device, void *arg, int future_time)
+{
+    DevEvent	event;
 
-    /*  This is not a clock interrupt - get the next event (from a device) */
-    dev_event_ptr++;
-    event_device = dev_event_queue[dev_event_ptr].device;
-    arg = dev_event_queue[dev_event_ptr].arg;
+    event.time = dev_tick + (future_time > 0 ? future_time : 1);
+    event.seq = dev_event_seq++;
+    event.device = device;
+    event.arg = arg;
+    dev_heap_push(&dev_timers, &event);
+}
+
+/*
+ *  Performs a device's action for an event and, if the action says a unit
+ *  interrupted, calls the user interrupt handler.
+ */
+static void dev_event_run(int event_device, void *arg)
+{
+    int unit_num = -1;
 
-    /*  Reset the queue entry to the terminal device and perform the
-	action for this device */
-    dev_event_queue[dev_event_ptr].device = LOW_PRI_DEV;
     switch(event_device)
     {
       case USLOSS_ALARM_DEV:
@@ -121,8 +210,8 @@ dynamic_fun void dispatch_int(void)
         {
 	    char msg[60];
 
-	    sprintf(msg, "illegal device number %d in event queue, index %u",
-		event_device, dev_event_ptr);
+	    sprintf(msg, "illegal device number %d in event queue, tick %lld",
+		event_device, dev_tick);
 	    usloss_usr_assert(0, msg);
 	}
     }
@@ -139,6 +228,60 @@ dynamic_fun void dispatch_int(void)
     }
 }
 
+/*
+ *  Gets the next event from the queue at interrupt time and performs
+ *  all processing needed for this interrupt - calling the device
+ *  action routine and the user interrupt handler.
+ */
+dynamic_fun void dispatch_int(void)
+{
+    static unsigned int tick = 0;
+    int unit_num;
+    DevEvent event;
+
+    /*  Update and check the 'tick' variable to see if this is a clock
+	interrupt */
+    tick = ~tick;
+    if (tick)
+    {
+        LOG(CLOCK_VERBOSITY, "Interrupt: %d (CLOCK), handler @ %p\n",
+            USLOSS_CLOCK_INT, USLOSS_IntVec[USLOSS_CLOCK_INT]);
+        clock_action();
+        if (USLOSS_IntVec[USLOSS_CLOCK_INT] == NULL) {
+            rpt_sim_trap("USLOSS_IntVec[USLOSS_CLOCK_INT] is NULL!\n");
+        }
+
+        (*USLOSS_IntVec[USLOSS_CLOCK_INT])(USLOSS_CLOCK_DEV, 0);
+        return;
+    }
+
+    /*  This is not a clock interrupt - get the next event (from a device).
+	A tick no device wants goes to the terminal, the lowest priority
+	device. */
+    dev_tick++;
+    if (!dev_event_next(&event))
+	dev_event_run(LOW_PRI_DEV, NULL);
+    else {
+	dev_event_run(event.device, event.arg);
+	while (dev_batch_ints && dev_event_next(&event))
+	    dev_event_run(event.device, event.arg);
+    }
+
+    /*  Terminals with a baud rate keep their own time, whatever device this
+	tick went to */
+    for (unit_num = 0; unit_num < USLOSS_TERM_UNITS; unit_num++)
+    {
+	if (term_baud_action(unit_num) != -1)
+	{
+	    USLOSSwaiting = 0;
+	    if (USLOSS_IntVec[USLOSS_TERM_INT] == NULL) {
+		rpt_sim_trap("USLOSS_IntVec contains NULL handle for interrupt.\n");
+	    }
+	    (*USLOSS_IntVec[USLOSS_TERM_INT])(USLOSS_TERM_DEV, (void *) unit_num);
+	}
+    }
+}
+
 /*
  *  Perform the inp() operation, which returns the status of a device.  We
  *  call on a per-device basis because the device may clear its status when
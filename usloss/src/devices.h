@@ -4,9 +4,18 @@
 
 #include "project.h"
 #include "usloss.h"
+#include "sig_ints.h"
+
+/*
+ *  Microseconds between device events. The timer goes off every ALARM_TIME,
+ *  and every other time it is the clock's, so schedule_int() counts in ticks
+ *  of twice that.
+ */
+#define DEVICE_TICK_TIME	(2 * ALARM_TIME)
 
 /*  Variables used by other USLOSS routines */
 dynamic_dcl int device_status[USLOSS_NUM_INTS];
+dynamic_dcl int dev_batch_ints;
 
 /*  Functions used by other USLOSS routines */
 dynamic_dcl void devices_init(void);
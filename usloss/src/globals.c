@@ -8,6 +8,7 @@
 #include "globals.h"
 #include "main.h"
 #include "sig_ints.h"
+#include "dev_term.h"
 #include "usloss.h"
 
 dynamic_def(unsigned int current_psr = USLOSS_PSR_MAGIC);
@@ -195,6 +196,7 @@ void USLOSS_Abort(char *fmt, ...)
     check_kernel_mode("USLOSS_Abort");
     (void) int_off();
     USLOSS_VConsole(fmt, ap);
+    term_halt();
 
     abort();
 }
@@ -250,6 +252,7 @@ dynamic_fun void rpt_cond(char *cond, char *file, int line, char *msg)
 dynamic_fun void rpt_sim_trap(char *msg)
 {
     fprintf(stderr, "SIMULATOR TRAP: %s\n", msg);
+    term_halt();
     abort();
 }
 
@@ -1,5 +1,6 @@
 
 #include <stdlib.h>
+#include <string.h>
 #include <getopt.h>
 #include "project.h"
 #include "usloss.h"
@@ -31,6 +32,33 @@ static void print_options()
     printf("  -h, --help               Print list of options and exit.\n");
     printf("  -r, --real-time          Set USLOSS to use real time. This is the default mode.\n");
     printf("  -R, --virtual-time       Set USLOSS to use virtual time.\n");
+    printf("  -m, --disk-mmap          Map the disk files into memory, so disk transfers are copies\n");
+    printf("                           instead of file reads and writes.\n");
+    printf("  --disk-sync=POLICY       When a mapped disk is written back to its file: halt (when\n");
+    printf("                           the simulation halts, the default), write (after every\n");
+    printf("                           write), or none (whenever the host does it).\n");
+    printf("  --disk-queue=N           Let each disk hold up to N (at most %d) commands queued with\n",
+           USLOSS_DISK_QUEUE_MAX);
+    printf("                           USLOSS_DISK_QUEUE and pick the order it serves them in.\n");
+    printf("                           The default is 1.\n");
+    printf("  --disk-order=ORDER       The order queued commands are served in: sstf (nearest\n");
+    printf("                           track first, the default), elevator, or fifo.\n");
+    printf("  --disk-model=MODEL       How long disk operations take: toy (the default), hdd or\n");
+    printf("                           ssd, each optionally followed by ,key=value settings:\n");
+    printf("                           seek=linear|sqrt, seekmin=US, seekmax=US, rpm=N, spt=N\n");
+    printf("                           (sectors per track), rate=KB/s, overhead=US. For example\n");
+    printf("                           --disk-model=hdd,rpm=5400,seekmax=20000.\n");
+    printf("  -u, --term-unbuffered    Write each character sent to a terminal to its term*.out\n");
+    printf("                           file at once, instead of a line at a time, for watching\n");
+    printf("                           the terminal while the simulation runs.\n");
+    printf("  --term-baud=[UNIT:]RECV[/XMIT]\n");
+    printf("                           Receive and send characters on a terminal, or all of\n");
+    printf("                           them, at a baud rate (10 bits a character), instead of\n");
+    printf("                           whenever the device has nothing else to do. XMIT\n");
+    printf("                           defaults to RECV; neither may be over 500, a character\n");
+    printf("                           a device tick. May be given once for each unit.\n");
+    printf("  --batch-ints             Deliver every device interrupt due on a device tick on\n");
+    printf("                           that tick, instead of one a tick.\n");
     printf("  -v, --verbose            Increase the verbosity level of USLOSS. The verbosity level\n");
     printf("                           is equal to the number of times this option is set.\n");
     printf("                           LEVELS:\n");
@@ -53,9 +81,18 @@ int main(int argc, char **argv)
         {"verbose", no_argument, NULL, 'v'},
         {"real-time", no_argument, NULL, 'r'},
         {"virtual-time", no_argument, NULL, 'R'},
-        {"help", no_argument, NULL, 'h'}
+        {"disk-mmap", no_argument, NULL, 'm'},
+        {"disk-sync", required_argument, NULL, 'd'},
+        {"disk-queue", required_argument, NULL, 'q'},
+        {"disk-order", required_argument, NULL, 'o'},
+        {"disk-model", required_argument, NULL, 'g'},
+        {"term-unbuffered", no_argument, NULL, 'u'},
+        {"term-baud", required_argument, NULL, 'b'},
+        {"batch-ints", no_argument, NULL, 'i'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
     };
-    while ((opt = getopt_long(argc, argv, "vrRh", longopt, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "vrRmuh", longopt, NULL)) != -1) {
         switch(opt) {
             case 'v':
                 verbosity++;
@@ -66,6 +103,60 @@ int main(int argc, char **argv)
             case 'R':
                 virtual_time = TRUE;
                 break;
+            case 'm':
+                disk_mmap = TRUE;
+                break;
+            case 'd':
+                if (strcmp(optarg, "halt") == 0) {
+                    disk_sync = DISK_SYNC_HALT;
+                } else if (strcmp(optarg, "write") == 0) {
+                    disk_sync = DISK_SYNC_WRITE;
+                } else if (strcmp(optarg, "none") == 0) {
+                    disk_sync = DISK_SYNC_NONE;
+                } else {
+                    fprintf(stderr, "Unknown --disk-sync policy %s\n", optarg);
+                    print_options();
+                    return 1;
+                }
+                break;
+            case 'q':
+                disk_queue_depth = atoi(optarg);
+                if (disk_queue_depth < 1 || disk_queue_depth > USLOSS_DISK_QUEUE_MAX) {
+                    fprintf(stderr, "--disk-queue must be from 1 to %d\n", USLOSS_DISK_QUEUE_MAX);
+                    return 1;
+                }
+                break;
+            case 'o':
+                if (strcmp(optarg, "sstf") == 0) {
+                    disk_queue_order = DISK_ORDER_SSTF;
+                } else if (strcmp(optarg, "elevator") == 0) {
+                    disk_queue_order = DISK_ORDER_ELEVATOR;
+                } else if (strcmp(optarg, "fifo") == 0) {
+                    disk_queue_order = DISK_ORDER_FIFO;
+                } else {
+                    fprintf(stderr, "Unknown --disk-order %s\n", optarg);
+                    print_options();
+                    return 1;
+                }
+                break;
+            case 'u':
+                term_unbuffered = TRUE;
+                break;
+            case 'i':
+                dev_batch_ints = TRUE;
+                break;
+            case 'b':
+                if (term_baud_set(optarg) == -1) {
+                    print_options();
+                    return 1;
+                }
+                break;
+            case 'g':
+                if (disk_model_set(optarg) == -1) {
+                    print_options();
+                    return 1;
+                }
+                break;
             case 'h':
                 print_options();
                 return 0;
@@ -108,6 +199,8 @@ int main(int argc, char **argv)
     current_psr = psr;
     finish(argc, argv);
     test_cleanup(argc, argv);
+    disk_halt();
+    term_halt();
     exit(finish_status);
 }
 
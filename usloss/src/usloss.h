@@ -109,6 +109,39 @@ typedef struct USLOSS_DeviceRequest
 #define USLOSS_DISK_WRITE	1
 #define USLOSS_DISK_SEEK	2
 #define USLOSS_DISK_TRACKS	3
+#define USLOSS_DISK_READ_MULTI	4
+#define USLOSS_DISK_WRITE_MULTI	5
+
+/*
+ *  reg1 of USLOSS_DISK_READ_MULTI and USLOSS_DISK_WRITE_MULTI: count
+ *  consecutive sectors of the current track, starting at first, all moved
+ *  to or from reg2 in one request and one interrupt.
+ */
+#define USLOSS_DISK_SECTORS(first, count)	((void *) (long) ((first) | ((count) << 8)))
+
+/*
+ *  USLOSS_DISK_QUEUE hands the disk a USLOSS_DiskCommand (reg1), which it
+ *  copies. Run with --disk-queue=N and the disk holds up to N commands per
+ *  unit, serves them in its own order (see --disk-order), and raises one
+ *  interrupt per command; otherwise it holds one. The status of that
+ *  interrupt carries the command's tag. USLOSS_DeviceOutput returns
+ *  USLOSS_DEV_BUSY while the queue is full.
+ */
+#define USLOSS_DISK_QUEUE	6
+#define USLOSS_DISK_QUEUE_MAX	32
+
+typedef struct USLOSS_DiskCommand
+{
+	int opr;	/* USLOSS_DISK_READ or USLOSS_DISK_WRITE */
+	int track;
+	int first;	/* first sector on the track */
+	int count;	/* sectors, no further than the end of the track */
+	void *buffer;
+	int tag;	/* 0 to 0xffffff, for the caller to match completions */
+} USLOSS_DiskCommand;
+
+#define USLOSS_DISK_STAT(status)	((status) & 0xff)
+#define USLOSS_DISK_STAT_TAG(status)	((status) >> 8)
 
 /*
  *  These are the status codes returned by USLOSS_DeviceInput(). In general, 
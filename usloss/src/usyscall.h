@@ -51,6 +51,14 @@
 
 #define SYS_DUMPPROCESSES   42
 
+#define SYS_SEMSTATS        43
+#define SYS_SEMTIMEDP       44
+#define SYS_SYSCALLSTATS    45
+#define SYS_DISKASYNC       46
+#define SYS_DISKIOV         47
+#define SYS_DISKSYNC        48
+#define SYS_DEVICESTATS     49
+
 // Leave some room for growth
 
 #define USLOSS_MAX_SYSCALLS 50